@@ -0,0 +1,77 @@
+#!/bin/sh
+# @file bench.sh
+# @author Ivan Cankov 12219400 <e12219400@student.tuwien.ac.at>
+# @date 05.11.2023
+#
+# @brief Runs every cpair engine on generated inputs and prints one line per run:
+# distribution, size, engine, wall time, peak RSS of a single process, summed peak RSS
+# of all processes, process count and the bytes written to pipes.
+#
+# Configured through the environment (make bench passes these on):
+#   SIZES          the input sizes (default "1e3 1e4 1e5 1e6", up to 1e8 works)
+#   DISTRIBUTIONS  the cpairgen distributions (default all of them)
+#   ENGINES        tree tree-mean tree-shm threads jobs grid (default all of them)
+#   TREE_LIMIT     the largest size the process tree engines run on (default 1e5)
+#   DIMENSIONS     the coordinates per point, the DIMENSIONS cpair was built with (default 2)
+#   THREADS        the threads of the threads engine and the processes of the jobs engine
+#                  (default the number of cpus)
+#   BENCH_DIR      where the inputs are cached (default $TMPDIR/cpair-bench)
+
+set -e
+
+SIZES=${SIZES:-"1e3 1e4 1e5 1e6"}
+DISTRIBUTIONS=${DISTRIBUTIONS:-"uniform clustered collinear duplicates adversarial"}
+ENGINES=${ENGINES:-"tree tree-mean tree-shm threads jobs grid"}
+TREE_LIMIT=${TREE_LIMIT:-1e5}
+DIMENSIONS=${DIMENSIONS:-2}
+THREADS=${THREADS:-$(getconf _NPROCESSORS_ONLN 2>/dev/null || echo 1)}
+BENCH_DIR=${BENCH_DIR:-${TMPDIR:-/tmp}/cpair-bench}
+
+mkdir -p "$BENCH_DIR"
+STATS="$BENCH_DIR/stats"
+
+printf "%-12s %8s %-10s %10s %12s %12s %10s %14s\n" \
+    distribution size engine wall_s peak_rss_kb sum_rss_kb processes pipe_bytes
+
+for dist in $DISTRIBUTIONS; do
+    for size in $SIZES; do
+        input="$BENCH_DIR/$dist-$size-${DIMENSIONS}d"
+        if [ ! -s "$input" ]; then
+            ./cpairgen -d "$DIMENSIONS" "$dist" "$size" > "$input"
+        fi
+
+        for engine in $ENGINES; do
+            case $engine in
+                tree) args="" ;;
+                tree-mean) args="--split mean" ;;
+                tree-shm) args="--shm" ;;
+                threads) args="--threads $THREADS" ;;
+                jobs) args="--jobs $THREADS" ;;
+                grid) args="--algo grid" ;;
+                *) echo "bench.sh: unknown engine $engine" >&2; exit 1 ;;
+            esac
+
+            case $engine in
+                tree*)
+                    if awk "BEGIN { exit !($size > $TREE_LIMIT) }"; then
+                        continue
+                    fi
+                    ;;
+            esac
+
+            rm -f "$STATS"
+            start=$(date +%s%N)
+            if ! CPAIR_STATS="$STATS" ./cpair $args < "$input" > /dev/null; then
+                echo "bench.sh: cpair $args failed on $input" >&2
+            fi
+            end=$(date +%s%N)
+
+            awk -v dist="$dist" -v size="$size" -v engine="$engine" -v ns="$((end - start))" '
+                { processes++; bytes += $3; sum += $4; if ($4 > peak) peak = $4 }
+                END {
+                    printf "%-12s %8s %-10s %10.3f %12d %12d %10d %14.0f\n",
+                        dist, size, engine, ns / 1e9, peak, sum, processes, bytes
+                }' "$STATS"
+        done
+    done
+done
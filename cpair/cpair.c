@@ -12,13 +12,202 @@
 #include "errno.h"
 #include "sys/wait.h"
 #include "sys/types.h"
+#include "sys/stat.h"
+#include "sys/mman.h"
+#include "sys/resource.h"
+#include "fcntl.h"
+#include "inttypes.h"
 #include "math.h"
+#include "stdint.h"
+#include "limits.h"
+#include "time.h"
+#include "getopt.h"
+#include "pool.h"
+
+#if defined(__AVX2__)
+#include "immintrin.h"
+#elif defined(__SSE2__)
+#include "emmintrin.h"
+#endif
+
+/**
+ * Sub problems with fewer points than this are not handed to other
+ * threads, as the bookkeeping would cost more than solving them directly.
+ */
+#define SPAWN_GRAIN (2048)
+
+/**
+ * Sub problems with at most this many points are solved directly
+ * instead of being split any further.
+ */
+#define DEFAULT_LEAF_SIZE (64)
+
+/**
+ * The grid engine hashes cells into at least GRID_LOAD buckets per point.
+ */
+#define GRID_LOAD (2)
+
+/**
+ * The number of kd-trees of the --stream index, enough for 2^STREAM_TREES - 1 points.
+ */
+#define STREAM_TREES (48)
+
+/**
+ * The number of points writeframe and readframe pack and unpack at once.
+ */
+#define FRAME_CHUNK (1024)
+
+/**
+ * The number of dimensions of the points, 2 to 8. Set with make DIMENSIONS=3.
+ */
+#ifndef DIMENSIONS
+#define DIMENSIONS (2)
+#endif
+#if DIMENSIONS < 2 || DIMENSIONS > 8
+#error "DIMENSIONS has to be between 2 and 8"
+#endif
+
+/**
+ * The type of a coordinate. make PRECISION=double builds cpair with double coordinates, which
+ * keeps large coordinates with small distances apart and prints every digit of them. The
+ * plain build uses float and prints 3 decimals.
+ * COORD_FORMAT prints a coordinate, COORD_EXACT prints one so that it parses back unchanged.
+ */
+#ifdef DOUBLE_PRECISION
+typedef double coord;
+#define strtocoord strtod
+#define nextcoord nextafter
+#define COORD_FORMAT "%.17g"
+#define COORD_EXACT "%.17g"
+#else
+typedef float coord;
+#define strtocoord strtof
+#define nextcoord nextafterf
+#define COORD_FORMAT "%.3f"
+#define COORD_EXACT "%.9g"
+#endif
+
+/**
+ * The number of candidates closerblock compares a point against at once.
+ */
+#if defined(__AVX2__) && !defined(DOUBLE_PRECISION)
+#define DISTANCE_BLOCK (8)
+#else
+#define DISTANCE_BLOCK (4)
+#endif
+
+typedef enum {
+    SPLIT_MEDIAN,
+    SPLIT_MEAN
+} splitmode;
+
+typedef enum {
+    ALGO_DIVIDE,
+    ALGO_GRID
+} algorithm;
 
 typedef struct {
-    float x;
-    float y;
+    size_t threads;
+    size_t jobs;
+    size_t leaf;
+    splitmode split;
+    algorithm algo;
+    size_t pairs;
+    coord radius;
+    int stream;
+    int child;
+    int shm;
+    const char *trace;
+    size_t depth;
+} options;
+
+#define AXES (DIMENSIONS)
+#define AXIS_X (0)
+#define AXIS_Y (1)
+
+/**
+ * The axis the in-process recursion and closestleaf sort the points along, y in the plane.
+ */
+#define SORT_AXIS (AXES - 1)
+
+typedef struct {
+    coord c[AXES];
 } point;
 
+/**
+ * Points stored as a structure of arrays: c[AXIS_X] holds all x coordinates, c[AXIS_Y] all
+ * y coordinates and so on. Loops that only look at one axis pick its array once instead of branching
+ * on the axis for every point, and walk over contiguous coordinates that the compiler can vectorize.
+ * Like a point array it does not know its own length, which is passed along as stored.
+ */
+typedef struct {
+    coord *c[AXES];
+} pointset;
+
+typedef struct {
+    point a;
+    point b;
+    coord distance;
+} pointpair;
+
+/**
+ * The result of a sub problem: the pairs found so far and their squared distances.
+ * With a limit of k it is a max heap of the k closest pairs, pairs[0] being the worst of them.
+ * With a limit of 0 it is a plain list of all pairs closer than bound, used for the radius query.
+ * The closest pair query is the k = 1 case. Memory is only allocated once a pair is added.
+ */
+typedef struct {
+    pointpair *pairs;
+    size_t count;
+    size_t capacity;
+    size_t limit;
+    coord bound;
+    const char *process;
+} pairlist;
+
+/**
+ * The file named by the CPAIR_STATS environment variable and the bytes this process has
+ * written to pipes so far, see writestats.
+ */
+static const char *statsFile = NULL;
+static uint64_t pipeBytes = 0;
+
+/**
+ * The shared memory region of --shm, which every process of the tree maps: its file descriptor
+ * (-1 without --shm), the mapping and the number of points per axis. The coordinates of an axis are
+ * stored at regionBase + axis * regionCapacity, and a process works on the range of regionOffset.
+ */
+static int regionFd = -1;
+static coord *regionBase = NULL;
+static size_t regionCapacity = 0;
+static size_t regionOffset = 0;
+
+/**
+ * @brief Appends the statistics of the current process to the CPAIR_STATS file when it exits.
+ * @details Writes one line "pid parent-pid pipe-bytes peak-rss-kb" with a single write to a file
+ * opened with O_APPEND, so the lines of all processes of the tree stay intact. The variable is
+ * inherited by every child, which lets bench.sh count the processes and sum up their pipe traffic.
+ */
+void writestats(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == -1) {
+        return;
+    }
+
+    char line[128];
+    int length = snprintf(line, sizeof(line), "%ld %ld %" PRIu64 " %ld\n", (long)getpid(), (long)getppid(),
+                          pipeBytes, (long)usage.ru_maxrss);
+
+    int fd = open(statsFile, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (fd == -1) {
+        return;
+    }
+    if (write(fd, line, length) != length) {
+        fprintf(stderr, "cpair: cannot write to %s\n", statsFile);
+    }
+    close(fd);
+}
+
 /**
  * @brief Print an error message to stderr and exit the process with EXIT_FAILURE.
  * @param process The name of the current process.
@@ -29,325 +218,2435 @@ void error(char *message, const char *process) {
 }
 
 /**
- * @brief Print a usage message to stderr and exit the process with EXIT_FAILURE.
- * @param process The name of the current process.
+ * What a process of the tree did, written to the --trace file by writetrace when it exits.
+ * kind is "leaf", "identical", "grid", "threads" or "split"; the split fields are only set for "split".
+ */
+typedef struct {
+    const char *kind;
+    double start;
+    double cpuStart;
+    ssize_t stored;
+    int axis;
+    coord divider;
+    ssize_t split;
+    size_t strip;
+    size_t comparisons;
+    double leftWait;
+    double rightWait;
+} tracenode;
+
+/**
+ * The file opened by --trace (-1 without it) and the node of the current process.
+ */
+static int traceFd = -1;
+static size_t traceDepth = 0;
+static tracenode traceNode = { .kind = "leaf", .axis = -1 };
+
+/**
+ * @brief Returns the time of a clock in microseconds, the unit of Chrome traces.
+ * @param clock CLOCK_MONOTONIC for wall time, which is shared by all processes,
+ * or CLOCK_PROCESS_CPUTIME_ID for the cpu time of the current process.
+ */
+double tracenow(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+/**
+ * @brief Appends a complete event ("ph":"X") from start until now to the trace file.
+ * @details Every event is a single line written with a single write to a file opened with O_APPEND,
+ * so the events of all processes stay intact. The tree shares one trace process (its process group)
+ * and every process of it gets its own thread row, so the phases of a process nest below its node.
+ * @param name The name of the event.
+ * @param start The wall time the event started at, see tracenow.
+ * @param args The members of the args object of the event, may be empty.
+ */
+void traceevent(const char *name, double start, const char *args) {
+    if (traceFd == -1) {
+        return;
+    }
+
+    char line[1024];
+    int length = snprintf(line, sizeof(line),
+                          "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%ld,\"tid\":%ld,\"ts\":%.3f,\"dur\":%.3f,"
+                          "\"args\":{%s}},\n", name, (long)getpgrp(), (long)getpid(), start,
+                          tracenow(CLOCK_MONOTONIC) - start, args);
+    if (length < 0 || (size_t)length >= sizeof(line) || write(traceFd, line, length) != length) {
+        fprintf(stderr, "cpair: cannot write the trace\n");
+    }
+}
+
+/**
+ * @brief Appends the node of the current process to the trace file when it exits.
+ * @details Names the thread row of the process after its depth and sorts the rows by depth,
+ * so the trace viewer shows the recursion level by level.
+ */
+void writetrace(void) {
+    char line[512];
+    int length = snprintf(line, sizeof(line),
+                          "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%ld,"
+                          "\"args\":{\"name\":\"depth %zu\"}},\n"
+                          "{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%ld,"
+                          "\"args\":{\"sort_index\":%zu}},\n", (long)getpgrp(), (long)getpid(), traceDepth,
+                          (long)getpgrp(), (long)getpid(), traceDepth);
+    if (length > 0 && (size_t)length < sizeof(line) && write(traceFd, line, length) != length) {
+        fprintf(stderr, "cpair: cannot write the trace\n");
+    }
+
+    char args[512];
+    int used = snprintf(args, sizeof(args), "\"depth\":%zu,\"n\":%zd,\"kind\":\"%s\",\"cpu_us\":%.3f",
+                        traceDepth, traceNode.stored, traceNode.kind,
+                        tracenow(CLOCK_PROCESS_CPUTIME_ID) - traceNode.cpuStart);
+    if (traceNode.axis >= 0 && used > 0 && (size_t)used < sizeof(args)) {
+        snprintf(args + used, sizeof(args) - used,
+                 ",\"axis\":%d,\"divider\":" COORD_EXACT ",\"left\":%zd,\"right\":%zd,\"strip\":%zu,"
+                 "\"comparisons\":%zu,\"left_us\":%.3f,\"right_us\":%.3f",
+                 traceNode.axis, (double)traceNode.divider, traceNode.split, traceNode.stored - traceNode.split,
+                 traceNode.strip, traceNode.comparisons, traceNode.leftWait, traceNode.rightWait);
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "%s n=%zd", traceNode.kind, traceNode.stored);
+    traceevent(name, traceNode.start, args);
+    close(traceFd);
+}
+
+/**
+ * @brief Opens the --trace file and starts the node of the current process.
+ * @details The first process truncates the file and starts the JSON array, whose closing bracket
+ * the trace viewers do not require. Its children only append their events.
+ * @param file The name of the trace file.
+ * @param depth The depth of the current process in the tree, 0 for the first one.
+ * @param process The name of the current process.
+ */
+void traceopen(const char *file, size_t depth, const char *process) {
+    traceNode.start = tracenow(CLOCK_MONOTONIC);
+    traceNode.cpuStart = tracenow(CLOCK_PROCESS_CPUTIME_ID);
+    traceDepth = depth;
+
+    traceFd = open(file, O_WRONLY | O_APPEND | O_CREAT | (depth == 0 ? O_TRUNC : 0), 0644);
+    if (traceFd == -1) {
+        fprintf(stderr, "[%s] ERROR: Cannot open trace file %s: %s\n", process, file, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    if (depth == 0 && write(traceFd, "[\n", 2) != 2) {
+        error("Cannot write the trace", process);
+    }
+    atexit(writetrace);
+}
+
+/**
+ * @brief Allocates a point set for the given number of points.
+ * @details All axes share one allocation, so the set is released with a single psfree.
+ * @param set &mut The set you intend to allocate.
+ * @param capacity The number of points the set has to hold.
+ * @return 0 on success, -1 if it was unable to allocate memory.
+ */
+int psalloc(pointset *set, size_t capacity) {
+    if (capacity == 0) {
+        capacity = 1;
+    }
+
+    coord *block = malloc(sizeof(coord) * AXES * capacity);
+    if (block == NULL) {
+        return -1;
+    }
+
+    for (int axis = 0; axis < AXES; axis++) {
+        set->c[axis] = block + axis * capacity;
+    }
+    return 0;
+}
+
+/**
+ * @brief Releases a point set allocated by psalloc.
+ * @param set &mut The set you intend to free.
+ */
+void psfree(pointset *set) {
+    free(set->c[0]);
+    set->c[0] = NULL;
+}
+
+/**
+ * @brief Returns the set that starts at the given offset of another set.
+ */
+pointset psoffset(pointset set, size_t offset) {
+    for (int axis = 0; axis < AXES; axis++) {
+        set.c[axis] += offset;
+    }
+    return set;
+}
+
+/**
+ * @brief Returns the point at the given index of a set.
+ */
+point psget(pointset set, size_t i) {
+    point p;
+    for (int axis = 0; axis < AXES; axis++) {
+        p.c[axis] = set.c[axis][i];
+    }
+    return p;
+}
+
+/**
+ * @brief Stores a point at the given index of a set.
+ */
+void psput(pointset set, size_t i, point p) {
+    for (int axis = 0; axis < AXES; axis++) {
+        set.c[axis][i] = p.c[axis];
+    }
+}
+
+/**
+ * @brief Swaps two points of a set.
+ */
+void psswap(pointset set, size_t i, size_t j) {
+    for (int axis = 0; axis < AXES; axis++) {
+        coord tmp = set.c[axis][i];
+        set.c[axis][i] = set.c[axis][j];
+        set.c[axis][j] = tmp;
+    }
+}
+
+/**
+ * @brief Copies a range of points from one set to another.
+ */
+void pscopy(pointset to, size_t toOffset, pointset from, size_t fromOffset, size_t count) {
+    for (int axis = 0; axis < AXES; axis++) {
+        memcpy(to.c[axis] + toOffset, from.c[axis] + fromOffset, sizeof(coord) * count);
+    }
+}
+
+/**
+ * @brief Print a usage message to stderr and exit the process with EXIT_FAILURE.
+ * @param process The name of the current process.
+ */
+void usage(const char *process) {
+    fprintf(stderr, "Usage: %s [-t|--threads N] [-j|--jobs P] [-l|--leaf N] [-s|--split median|mean]\n"
+            "       [-a|--algo divide|grid] [-k|--pairs K | -r|--radius R] [--shm] [--stream] [--trace FILE]\n", process);
+    fprintf(stderr, "  -t, --threads N  solve in-process with N threads instead of a process tree\n");
+    fprintf(stderr, "  -j, --jobs P     only fork the top ceil(log2 P) levels, solve below them in-process\n"
+            "                   (with --threads N threads each)\n");
+    fprintf(stderr, "  -l, --leaf N     solve sub problems of at most N >= 2 points directly (default %d)\n",
+            DEFAULT_LEAF_SIZE);
+    fprintf(stderr, "  -s, --split M    split the points at their median (default) or their mean\n");
+    fprintf(stderr, "  -a, --algo A     divide and conquer (default) or hash the points into a grid\n");
+    fprintf(stderr, "  -k, --pairs K    print the K closest pairs instead of only the closest one\n");
+    fprintf(stderr, "  -r, --radius R   print every pair of points at most R apart\n");
+    fprintf(stderr, "      --shm        hand the children ranges of shared memory instead of piping points\n");
+    fprintf(stderr, "      --stream     insert (+ x y) and delete (- x y) points, print the closest pair on empty lines\n");
+    fprintf(stderr, "      --trace FILE write a Chrome trace (JSON) of every process of the tree to FILE\n");
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Prints a point to a file.
+ * @details It is assumed that both parameters are valid.
+ * @param file The file you intend to write to.
+ * @param p The point you intend to write to the file.
+ */
+int ptofile(FILE *file, point *p) {
+    for (int axis = 0; axis < AXES; axis++) {
+        if (fprintf(file, COORD_FORMAT "%c", p->c[axis], (axis == AXES - 1) ? '\n' : ' ') < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Returns the mean of the coordinates of one axis of a point set.
+ * @details It is assumed that both parameters are valid.
+ * @param coordinates The coordinates of the axis you intend to calculate the mean of, e.g. set.c[AXIS_X].
+ * @param stored The amount of points in the point set.
+ */
+coord meanpx(const coord *coordinates, size_t stored) {
+    coord sum = 0;
+    for (size_t i = 0; i < stored; i++) {
+        sum += coordinates[i];
+    }
+    sum /= (coord)stored;
+    return (coord)sum;
+}
+
+/**
+ * @brief Parses a string to a point.
+ * @details Throws an error and exits if the string is not of a valid format.
+ * @param input The string you intend to covert to a point.
+ * @param process The name of the current process.
+ */
+point strtop(char *input, const char *process) {
+    point p;
+
+    // All coordinates but the last end at a space, the last one at the end of the line
+    for (int axis = 0; axis < AXES; axis++) {
+        char *str = strtok((axis == 0) ? input : NULL, (axis == AXES - 1) ? "\n" : " ");
+        if (str == NULL) {
+            error("Malformed input line", process);
+        }
+
+        char *endptr;
+        p.c[axis] = strtocoord(str, &endptr);
+        if (*endptr != '\0') {
+            error("Malformed input line", process);
+        }
+    }
+
+    return p;
+}
+
+/**
+ * @brief Closes all ends of both child pipe
+ * @details It is assumed that all necessary file descriptor duplications were done prior to calling this function
+ * @param rightReadPipe The right parent read pipe that you intend to close.
+ * @param leftReadPipe The left parent read pipe that you intend to close.
+ * @param rightWritePipe The left parent write pipe that you intend to close.
+ * @param leftWritePipe The left parent write pipe that you intend to close.
+ */
+void closepipes(int rightReadPipe[2], int leftReadPipe[2], int rightWritePipe[2], int leftWritePipe[2]) {
+    close(rightReadPipe[0]);
+    close(rightReadPipe[1]);
+    close(rightWritePipe[0]);
+    close(rightWritePipe[1]);
+    close(leftReadPipe[0]);
+    close(leftWritePipe[1]);
+    close(leftReadPipe[1]);
+    close(leftWritePipe[0]);
+}
+
+/**
+ * @brief Converts standard in to a point set.
+ * @details Dynamically allocates memory to store the points.
+ * @param points &mut An UNINITIALISED point set.
+ * @param process The name of the current process.
+ * @return A signed size that indicates the size of the set.
+ */
+ssize_t stdintopa(pointset *points, const char *process)
+{
+    ssize_t stored = 0;
+    size_t capacity = 1024;
+
+    if (psalloc(points, capacity) == -1)
+    {
+        error("Failed to allocate memory", process);
+    }
+
+    char *line = NULL;
+    size_t linelen = 0;
+    while (getline(&line, &linelen, stdin) != -1)
+    {
+        // Resize
+        if (capacity == stored)
+        {
+            pointset tmp;
+            if (psalloc(&tmp, capacity * 2) == -1)
+            {
+                free(line);
+                psfree(points);
+                error("Failed to allocate memory", process);
+            }
+            pscopy(tmp, 0, *points, 0, stored);
+            psfree(points);
+            *points = tmp;
+            capacity *= 2;
+        }
+
+        point p = strtop(line, process);
+        psput(*points, stored, p);
+        stored++;
+    }
+
+    free(line);
+    return stored;
+}
+
+/**
+ * @brief Parses one line of a mapped input file to a point.
+ * @details Accepts the same format as strtop, but works on the mapping directly instead of a
+ * NUL-terminated copy of the line. The line has to be followed by a newline, so that strtocoord can
+ * never run past the end of the mapping.
+ * @param line The first character of the line.
+ * @param end The newline that terminates the line.
+ * @param process The name of the current process.
+ */
+point mtop(const char *line, const char *end, const char *process) {
+    point p;
+    char *endptr;
+
+    for (int axis = 0; axis < AXES; axis++) {
+        // strtocoord skips whitespace including newlines, so never let it start on any
+        while (line < end && *line == ' ') {
+            line++;
+        }
+        if (line == end) {
+            error("Malformed input line", process);
+        }
+
+        p.c[axis] = strtocoord(line, &endptr);
+        if (endptr == line) {
+            error("Malformed input line", process);
+        }
+        if (axis < AXES - 1 && (endptr == end || *endptr != ' ')) {
+            error("Malformed input line", process);
+        }
+        if (axis == AXES - 1 && endptr != end) {
+            error("Malformed input line", process);
+        }
+        line = endptr;
+    }
+
+    return p;
+}
+
+/**
+ * @brief Converts a regular file to a point set without copying it line by line.
+ * @details Maps the whole file, counts its lines to allocate the point set exactly once and then
+ * parses it in a single pass. A last line without a newline is copied, as it is the only one
+ * strtocoord could read past the end of the mapping from.
+ * @param fd The file descriptor of the regular file.
+ * @param size The size of the file in bytes, greater than 0.
+ * @param points &mut An UNINITIALISED point set.
+ * @param process The name of the current process.
+ * @return A signed size that indicates the size of the set.
+ */
+ssize_t filetopa(int fd, size_t size, pointset *points, const char *process) {
+    const char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        error("Cannot map input file", process);
+    }
+    madvise((void *)data, size, MADV_SEQUENTIAL);
+
+    const char *end = data + size;
+    size_t capacity = (data[size - 1] != '\n');
+    for (const char *c = data; (c = memchr(c, '\n', end - c)) != NULL; c++) {
+        capacity++;
+    }
+
+    if (psalloc(points, capacity) == -1) {
+        munmap((void *)data, size);
+        error("Failed to allocate memory", process);
+    }
+
+    ssize_t stored = 0;
+    const char *line = data;
+    while (line < end) {
+        const char *eol = memchr(line, '\n', end - line);
+        if (eol == NULL) {
+            // The copy is as long as the line, which may hold up to DIMENSIONS numbers of any length
+            size_t length = end - line;
+            char *last = malloc(length + 2);
+            if (last == NULL) {
+                munmap((void *)data, size);
+                error("Failed to allocate memory", process);
+            }
+            memcpy(last, line, length);
+            last[length] = '\n';
+            last[length + 1] = '\0';
+            psput(*points, stored++, mtop(last, last + length, process));
+            free(last);
+            break;
+        }
+
+        psput(*points, stored++, mtop(line, eol, process));
+        line = eol + 1;
+    }
+
+    munmap((void *)data, size);
+    return stored;
+}
+
+/**
+ * @brief Converts the input of the root process to a point set.
+ * @details If stdin is a regular file (which includes shared memory segments under /dev/shm),
+ * it is mapped and parsed in one pass by filetopa. Pipes and terminals are read with stdintopa.
+ * @param points &mut An UNINITIALISED point set.
+ * @param process The name of the current process.
+ * @return A signed size that indicates the size of the set.
+ */
+ssize_t inputtopa(pointset *points, const char *process) {
+    struct stat st;
+
+    if (fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        off_t offset = lseek(STDIN_FILENO, 0, SEEK_CUR);
+        if (offset == 0) {
+            return filetopa(STDIN_FILENO, (size_t)st.st_size, points, process);
+        }
+    }
+
+    return stdintopa(points, process);
+}
+
+/**
+ * @brief Writes a frame of points in the binary format used between a parent and its children.
+ * @details A frame is the number of points as a uint64_t followed by the packed point structs.
+ * Only the root process talks text, all pipes inside the process tree carry frames. The point
+ * set is packed into point structs in chunks of FRAME_CHUNK points on the way out.
+ * @param file The file you intend to write to.
+ * @param points The points you intend to write.
+ * @param stored The number of points stored in the point set.
+ * @return 0 on success, -1 if the frame could not be written completely.
+ */
+int writeframe(FILE *file, pointset points, size_t stored) {
+    uint64_t count = stored;
+    point chunk[FRAME_CHUNK];
+
+    if (fwrite(&count, sizeof(count), 1, file) != 1) {
+        return -1;
+    }
+    pipeBytes += sizeof(count) + sizeof(point) * count;
+
+    for (size_t offset = 0; offset < stored; offset += FRAME_CHUNK) {
+        size_t length = (stored - offset < FRAME_CHUNK) ? stored - offset : FRAME_CHUNK;
+        for (size_t i = 0; i < length; i++) {
+            chunk[i] = psget(points, offset + i);
+        }
+        if (fwrite(chunk, sizeof(point), length, file) != length) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Reads a frame of points written by writeframe.
+ * @details Dynamically allocates exactly as much memory as the frame header announces.
+ * @param file The file you intend to read from.
+ * @param points &mut An UNINITIALISED point set.
+ * @param process The name of the current process.
+ * @return The number of points read. Exits the process if the frame is malformed.
+ */
+ssize_t readframe(FILE *file, pointset *points, const char *process) {
+    uint64_t count;
+    point chunk[FRAME_CHUNK];
+
+    if (fread(&count, sizeof(count), 1, file) != 1) {
+        error("Malformed frame header", process);
+    }
+    if (count > SSIZE_MAX / sizeof(point)) {
+        error("Frame too large", process);
+    }
+
+    if (psalloc(points, count) == -1) {
+        error("Failed to allocate memory", process);
+    }
+
+    for (size_t offset = 0; offset < count; offset += FRAME_CHUNK) {
+        size_t length = (count - offset < FRAME_CHUNK) ? count - offset : FRAME_CHUNK;
+        if (fread(chunk, sizeof(point), length, file) != length) {
+            psfree(points);
+            error("Truncated frame", process);
+        }
+        for (size_t i = 0; i < length; i++) {
+            psput(*points, offset + i, chunk[i]);
+        }
+    }
+
+    return (ssize_t)count;
+}
+
+/**
+ * @brief Moves a point set into a new shared memory region for --shm.
+ * @details The shared memory object is unlinked right away and only reachable through its file
+ * descriptor, which is inherited through exec by the whole tree, so nothing is left behind in
+ * /dev/shm however the processes end.
+ * @param points &mut The points you intend to share, a set allocated by psalloc. Refers to the region afterwards.
+ * @param stored The number of points stored in the point set.
+ * @param process The name of the current process.
+ */
+void regionalloc(pointset *points, size_t stored, const char *process) {
+    char name[64];
+    snprintf(name, sizeof(name), "/cpair-%ld", (long)getpid());
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd == -1) {
+        error("Cannot create shared memory", process);
+    }
+    shm_unlink(name);
+
+    size_t size = sizeof(coord) * AXES * stored;
+    if (ftruncate(fd, size) == -1) {
+        error("Cannot resize shared memory", process);
+    }
+
+    coord *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        error("Cannot map shared memory", process);
+    }
+
+    // shm_open sets FD_CLOEXEC, but the children have to inherit the descriptor
+    if (fcntl(fd, F_SETFD, 0) == -1) {
+        error("Cannot share the shared memory", process);
+    }
+
+    pointset shared;
+    for (int axis = 0; axis < AXES; axis++) {
+        shared.c[axis] = base + axis * stored;
+    }
+    pscopy(shared, 0, *points, 0, stored);
+    psfree(points);
+    *points = shared;
+
+    regionFd = fd;
+    regionBase = base;
+    regionCapacity = stored;
+    regionOffset = 0;
+}
+
+/**
+ * @brief Writes the range of the region a child works on, two uint64_t offset and count.
+ * @param file The file you intend to write to.
+ * @param offset The index of the first point of the range.
+ * @param count The number of points of the range.
+ * @return 0 on success, -1 if the range could not be written.
+ */
+int writerange(FILE *file, size_t offset, size_t count) {
+    uint64_t range[2] = { offset, count };
+
+    if (fwrite(range, sizeof(range), 1, file) != 1) {
+        return -1;
+    }
+    pipeBytes += sizeof(range);
+    return 0;
+}
+
+/**
+ * @brief Maps the region inherited through --shm and reads the range written by writerange.
+ * @param fd The file descriptor of the region.
+ * @param file The file you intend to read the range from.
+ * @param points &mut An UNINITIALISED point set, refers to the range of the region afterwards.
+ * @param process The name of the current process.
+ * @return The number of points of the range.
+ */
+ssize_t regiontopa(int fd, FILE *file, pointset *points, const char *process) {
+    uint64_t range[2];
+    if (fread(range, sizeof(range), 1, file) != 1) {
+        error("Malformed range", process);
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == -1 || info.st_size <= 0) {
+        error("Cannot access shared memory", process);
+    }
+
+    size_t capacity = (size_t)info.st_size / (sizeof(coord) * AXES);
+    if (range[0] > capacity || range[1] > capacity - range[0]) {
+        error("Range outside of the shared memory", process);
+    }
+
+    coord *base = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        error("Cannot map shared memory", process);
+    }
+
+    regionFd = fd;
+    regionBase = base;
+    regionCapacity = capacity;
+    regionOffset = range[0];
+
+    for (int axis = 0; axis < AXES; axis++) {
+        points->c[axis] = base + axis * capacity + regionOffset;
+    }
+    return (ssize_t)range[1];
+}
+
+/**
+ * @brief Releases the points of the current process, whether they are in the region or not.
+ * @param points &mut The points you intend to release.
+ */
+void releasepoints(pointset *points) {
+    if (regionBase != NULL) {
+        munmap(regionBase, sizeof(coord) * AXES * regionCapacity);
+        regionBase = NULL;
+        points->c[0] = NULL;
+    } else {
+        psfree(points);
+    }
+}
+
+/**
+ * @brief A function that calculates the squared euclidean distance of 2 points.
+ * @details Comparing squared distances gives the same order as comparing distances,
+ * without a square root per comparison.
+ * @param p1 Point one
+ * @param p2 Point two
+ * @return The squared euclidean distance of of the aforementioned points.
+ */
+coord sqdistance(point p1, point p2) {
+    coord d = p2.c[0] - p1.c[0];
+    coord sum = d * d;
+    for (int axis = 1; axis < AXES; axis++) {
+        d = p2.c[axis] - p1.c[axis];
+        sum += d * d;
+    }
+    return sum;
+}
+
+/**
+ * @brief Creates an empty pair list for the query given by the options.
+ * @param opts The options of the current process.
+ * @param process The name of the current process, used to report allocation failures.
+ */
+pairlist plinit(const options *opts, const char *process) {
+    pairlist list = { .pairs = NULL, .count = 0, .capacity = 0, .limit = opts->pairs, .bound = INFINITY,
+                      .process = process };
+
+    if (opts->radius >= 0) {
+        // Pairs exactly radius apart are part of the result, bound is exclusive
+        list.limit = 0;
+        list.bound = nextcoord(opts->radius * opts->radius, INFINITY);
+    }
+    return list;
+}
+
+/**
+ * @brief Creates an empty pair list for the same query as another one.
+ */
+pairlist plempty(const pairlist *like) {
+    pairlist list = *like;
+    list.pairs = NULL;
+    list.count = 0;
+    list.capacity = 0;
+    return list;
+}
+
+/**
+ * @brief Releases the pairs of a pair list.
+ */
+void plfree(pairlist *list) {
+    free(list->pairs);
+    list->pairs = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+/**
+ * @brief Returns the squared distance a pair has to be below to be added to the list.
+ * @details This is what the closest pair search calls the best distance: the strip width
+ * and the early exits of the scans are derived from it.
+ */
+coord plbound(const pairlist *list) {
+    if (list->limit == 0 || list->count < list->limit) {
+        return list->bound;
+    }
+    return list->pairs[0].distance;
+}
+
+/**
+ * @brief Adds a pair to a list if its squared distance is below plbound.
+ * @param list &mut The list you intend to add to.
+ * @param a The first point of the pair.
+ * @param b The second point of the pair.
+ * @param distance The squared distance of a and b.
+ */
+void pladd(pairlist *list, point a, point b, coord distance) {
+    if (!(distance < plbound(list))) {
+        return;
+    }
+
+    pointpair pair = { .a = a, .b = b, .distance = distance };
+    size_t i;
+
+    if (list->limit != 0 && list->count == list->limit) {
+        // Replace the worst pair and sift it down
+        i = 0;
+        for (;;) {
+            size_t child = 2 * i + 1;
+            if (child >= list->count) {
+                break;
+            }
+            if (child + 1 < list->count && list->pairs[child + 1].distance > list->pairs[child].distance) {
+                child++;
+            }
+            if (list->pairs[child].distance <= distance) {
+                break;
+            }
+            list->pairs[i] = list->pairs[child];
+            i = child;
+        }
+        list->pairs[i] = pair;
+        return;
+    }
+
+    if (list->count == list->capacity) {
+        size_t capacity = (list->capacity == 0) ? 1 : list->capacity * 2;
+        if (list->limit != 0 && capacity > list->limit) {
+            capacity = list->limit;
+        }
+        pointpair *tmp = realloc(list->pairs, sizeof(pointpair) * capacity);
+        if (tmp == NULL) {
+            error("Failed to allocate memory", list->process);
+        }
+        list->pairs = tmp;
+        list->capacity = capacity;
+    }
+
+    i = list->count++;
+    if (list->limit != 0) {
+        // Sift the new pair up
+        while (i > 0 && list->pairs[(i - 1) / 2].distance < distance) {
+            list->pairs[i] = list->pairs[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+    }
+    list->pairs[i] = pair;
+}
+
+/**
+ * @brief Merges the pairs of two sub problems into one list.
+ * @details The smaller list is added to the larger one, which is what into holds afterwards.
+ * @param into &mut The pairs of one sub problem, receives the merged list.
+ * @param from &mut The pairs of the other sub problem, released afterwards.
+ */
+void plmerge(pairlist *into, pairlist *from) {
+    if (into->count < from->count) {
+        pairlist tmp = *into;
+        *into = *from;
+        *from = tmp;
+    }
+
+    for (size_t i = 0; i < from->count; i++) {
+        pladd(into, from->pairs[i].a, from->pairs[i].b, from->pairs[i].distance);
+    }
+    plfree(from);
+}
+
+/**
+ * @brief Compares 2 pairs by their distance, used to print the result in ascending order.
+ */
+int comparepairs(const void *p1, const void *p2) {
+    coord d1 = ((const pointpair *)p1)->distance;
+    coord d2 = ((const pointpair *)p2)->distance;
+    return (d1 > d2) - (d1 < d2);
+}
+
+/**
+ * @brief Writes a pair list to a parent as a frame of 2 points per pair.
+ * @param file The file you intend to write to.
+ * @param list The pairs you intend to write.
+ * @return 0 on success, -1 if the frame could not be written completely.
+ */
+int writepairs(FILE *file, const pairlist *list) {
+    uint64_t count = 2 * list->count;
+
+    if (fwrite(&count, sizeof(count), 1, file) != 1) {
+        return -1;
+    }
+    pipeBytes += sizeof(count) + sizeof(point) * count;
+    for (size_t i = 0; i < list->count; i++) {
+        if (fwrite(&list->pairs[i].a, sizeof(point), 1, file) != 1 ||
+            fwrite(&list->pairs[i].b, sizeof(point), 1, file) != 1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Reads and drops the rest of a child's output, so the child does not block on a full pipe.
+ * @param file The file to which the child writes its output frame.
+ */
+void skipoutput(FILE *file) {
+    char scratch[BUFSIZ];
+    while (fread(scratch, 1, sizeof(scratch), file) > 0) {
+    }
+}
+
+/**
+ * @brief Reads the pairs a child has written with writepairs.
+ * @details On malformed output the rest of it is skipped, so the child can still exit and be
+ * reaped before the error is reported.
+ * @param file The file to which the child has written its output frame.
+ * @param list &mut The list the pairs are added to.
+ * @return 0 on success, -1 if the output is malformed or truncated.
+ */
+int readpairs(FILE *file, pairlist *list) {
+    uint64_t count;
+    point pair[2];
+
+    if (fread(&count, sizeof(count), 1, file) != 1 || count % 2 != 0) {
+        skipoutput(file);
+        return -1;
+    }
+    for (uint64_t i = 0; i < count; i += 2) {
+        if (fread(pair, sizeof(point), 2, file) != 2) {
+            skipoutput(file);
+            return -1;
+        }
+        pladd(list, pair[0], pair[1], sqdistance(pair[0], pair[1]));
+    }
+    return 0;
+}
+
+/**
+ * @brief Checks the exit status of a child and reports a failed one on stderr.
+ * @param side The side of the split the child has solved, "left" or "right".
+ * @param status The status waitpid returned for the child.
+ * @param process The name of the current process.
+ * @return 1 if the child failed, 0 if it exited with EXIT_SUCCESS.
+ */
+int childfailed(const char *side, int status, const char *process) {
+    if (WIFSIGNALED(status)) {
+        fprintf(stderr, "[%s] ERROR: The %s child was killed by signal %d\n", process, side, WTERMSIG(status));
+        return 1;
+    }
+    if (WEXITSTATUS(status) != EXIT_SUCCESS) {
+        fprintf(stderr, "[%s] ERROR: The %s child exited with status %d\n", process, side, WEXITSTATUS(status));
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Compares a point against a block of candidates at once.
+ * @details Uses AVX2 for blocks of 8 floats or 4 doubles, or SSE2 for blocks of 4 floats when the
+ * compiler targets them (see SIMD in the Makefile) and a scalar loop otherwise or for incomplete
+ * blocks. The candidates are loaded straight from the coordinate arrays of a point set. The loops
+ * over the axes have a constant trip count and are unrolled by the compiler.
+ * @param p The point you intend to compare.
+ * @param candidates The set whose first points you intend to compare against.
+ * @param count The number of candidates, at most DISTANCE_BLOCK.
+ * @param best The squared distance a candidate has to beat.
+ * @param distances &mut Receives the squared distance of every candidate.
+ * @return A bit mask with bit i set if candidate i is closer to p than best.
+ */
+unsigned int closerblock(point p, pointset candidates, size_t count, coord best,
+                         coord distances[DISTANCE_BLOCK]) {
+#if defined(__AVX2__) && !defined(DOUBLE_PRECISION)
+    if (count == DISTANCE_BLOCK) {
+        __m256 delta = _mm256_sub_ps(_mm256_loadu_ps(candidates.c[0]), _mm256_set1_ps(p.c[0]));
+        __m256 d = _mm256_mul_ps(delta, delta);
+        for (int axis = 1; axis < AXES; axis++) {
+            delta = _mm256_sub_ps(_mm256_loadu_ps(candidates.c[axis]), _mm256_set1_ps(p.c[axis]));
+            d = _mm256_add_ps(d, _mm256_mul_ps(delta, delta));
+        }
+        _mm256_storeu_ps(distances, d);
+        return (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(d, _mm256_set1_ps(best), _CMP_LT_OQ));
+    }
+#elif defined(__AVX2__)
+    if (count == DISTANCE_BLOCK) {
+        __m256d delta = _mm256_sub_pd(_mm256_loadu_pd(candidates.c[0]), _mm256_set1_pd(p.c[0]));
+        __m256d d = _mm256_mul_pd(delta, delta);
+        for (int axis = 1; axis < AXES; axis++) {
+            delta = _mm256_sub_pd(_mm256_loadu_pd(candidates.c[axis]), _mm256_set1_pd(p.c[axis]));
+            d = _mm256_add_pd(d, _mm256_mul_pd(delta, delta));
+        }
+        _mm256_storeu_pd(distances, d);
+        return (unsigned int)_mm256_movemask_pd(_mm256_cmp_pd(d, _mm256_set1_pd(best), _CMP_LT_OQ));
+    }
+#elif defined(__SSE2__) && !defined(DOUBLE_PRECISION)
+    if (count == DISTANCE_BLOCK) {
+        __m128 delta = _mm_sub_ps(_mm_loadu_ps(candidates.c[0]), _mm_set1_ps(p.c[0]));
+        __m128 d = _mm_mul_ps(delta, delta);
+        for (int axis = 1; axis < AXES; axis++) {
+            delta = _mm_sub_ps(_mm_loadu_ps(candidates.c[axis]), _mm_set1_ps(p.c[axis]));
+            d = _mm_add_ps(d, _mm_mul_ps(delta, delta));
+        }
+        _mm_storeu_ps(distances, d);
+        return (unsigned int)_mm_movemask_ps(_mm_cmplt_ps(d, _mm_set1_ps(best)));
+    }
+#endif
+    unsigned int mask = 0;
+    for (size_t i = 0; i < count; i++) {
+        coord delta = candidates.c[0][i] - p.c[0];
+        distances[i] = delta * delta;
+        for (int axis = 1; axis < AXES; axis++) {
+            delta = candidates.c[axis][i] - p.c[axis];
+            distances[i] += delta * delta;
+        }
+        if (distances[i] < best) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
+/**
+ * @brief Prints a pair of points to a given file.
+ * @param file The file you intend to print to.
+ * @param pair &mut An array of exactly 2 points.
+ */
+void printpairsorted(FILE *file, point pair[2], const char *process) {
+    int result;
+
+    // Compare the points lexicographically, x first
+    int axis = 0;
+    while (axis < AXES - 1 && pair[0].c[axis] == pair[1].c[axis]) {
+        axis++;
+    }
+
+    if (pair[0].c[axis] <= pair[1].c[axis]) {
+        result = ptofile(file, &pair[0]);
+        if (result == -1) {
+            error("Error writing to file", process);
+        }
+
+        result = ptofile(file, &pair[1]);
+        if (result == -1) {
+            error("Error writing to file", process);
+        }
+    } else {
+        result = ptofile(file, &pair[1]);
+        if (result == -1) {
+            error("Error writing to file", process);
+        }
+
+        result = ptofile(file, &pair[0]);
+        if (result == -1) {
+            error("Error writing to file", process);
+        }
+    }
+}
+
+/**
+ * @brief Prints the result of the current process.
+ * @details The root prints the pairs as text in ascending order of their distance, separated
+ * by empty lines. Children answer their parent with a frame.
+ * @param opts The options of the current process.
+ * @param list &mut The pairs found, sorted by the root.
+ * @param process The name of the current process.
+ */
+void printresult(const options *opts, pairlist *list, const char *process) {
+    if (opts->child) {
+        if (writepairs(stdout, list) == -1) {
+            error("Error writing to parent", process);
+        }
+    } else {
+        qsort(list->pairs, list->count, sizeof(pointpair), comparepairs);
+        for (size_t i = 0; i < list->count; i++) {
+            point pair[2] = { list->pairs[i].a, list->pairs[i].b };
+            if (i > 0 && fputc('\n', stdout) == EOF) {
+                error("Error writing to file", process);
+            }
+            printpairsorted(stdout, pair, process);
+        }
+    }
+    fflush(stdout);
+}
+
+/**
+ * @brief Sends points to 2 child processes.
+ * @param points The points you intend to send to a child process, already split by splitpoints.
+ * @param stored The number of points stored in the point set.
+ * @param split The number of points that belong to the left child.
+ * @param leftWriteFile The file descriptor of the left child.
+ * @param rightWriteFile The file descriptor of the right child.
+ * @return 0 on success, -1 if a child could not be written to.
+ */
+int ptoc(pointset points, ssize_t stored, ssize_t split, FILE *leftWriteFile, FILE *rightWriteFile) {
+    if (writeframe(leftWriteFile, points, split) == -1) {
+        return -1;
+    }
+    return writeframe(rightWriteFile, psoffset(points, split), stored - split);
+}
+
+/**
+ * @brief Returns how far the coordinates of one axis are spread.
+ * @param coordinates The coordinates of the axis you intend to measure.
+ * @param stored The number of points stored in the point set.
+ * @return The largest minus the smallest coordinate, 0 exactly if all coordinates are identical.
+ */
+coord coordinatespread(const coord *coordinates, ssize_t stored) {
+    coord min = coordinates[0];
+    coord max = coordinates[0];
+
+    for (ssize_t i = 1; i < stored; i++) {
+        min = (coordinates[i] < min) ? coordinates[i] : min;
+        max = (coordinates[i] > max) ? coordinates[i] : max;
+    }
+
+    return (max > min) ? max - min : 0;
+}
+
+/**
+ * @brief Sorts a point set along one axis with a stable merge sort.
+ * @param points &mut The points you intend to sort.
+ * @param stored The number of points stored in the point set.
+ * @param axis The axis you intend to sort along.
+ * @param scratch &mut Scratch space for at least stored points.
+ */
+void sortpoints(pointset points, size_t stored, int axis, pointset scratch) {
+    const coord *key = points.c[axis];
+
+    if (stored <= 16) {
+        for (size_t i = 1; i < stored; i++) {
+            for (size_t j = i; j > 0 && key[j - 1] > key[j]; j--) {
+                psswap(points, j - 1, j);
+            }
+        }
+        return;
+    }
+
+    size_t half = stored / 2;
+    sortpoints(points, half, axis, scratch);
+    sortpoints(psoffset(points, half), stored - half, axis, scratch);
+
+    size_t i = 0;
+    size_t j = half;
+    for (size_t merged = 0; merged < stored; merged++) {
+        size_t next = (j >= stored || (i < half && key[i] <= key[j])) ? i++ : j++;
+        for (int a = 0; a < AXES; a++) {
+            scratch.c[a][merged] = points.c[a][next];
+        }
+    }
+
+    pscopy(points, 0, scratch, 0, stored);
+}
+
+/**
+ * @brief Checks the pairs of the strip around the split for pairs that belong into mergedChildren.
+ * @details The strip has to be sorted along an axis that was not split. Each point is only
+ * compared with the following points that are closer than the bound of the list along that axis,
+ * which are at most a constant number for the closest pair in the plane. The comparisons are done
+ * in blocks by closerblock and only the candidates that beat the bound are looked at one by one.
+ * @param strip The points within the bound of the split, sorted along the axis sortedBy.
+ * @param sides The side of the split every strip point belongs to.
+ * @param count The number of points stored in the strip.
+ * @param mergedChildren &mut Initially the merged pairs of the two sub problems.
+ * @param sortedBy The axis the strip is sorted along.
+ * @return The number of distances that were computed.
+ */
+size_t mergestrip(pointset strip, const unsigned char *sides, size_t count, pairlist *mergedChildren, int sortedBy) {
+    coord distances[DISTANCE_BLOCK];
+    const coord *order = strip.c[sortedBy];
+    size_t comparisons = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        point p = psget(strip, i);
+        for (size_t j = i + 1; j < count; j += DISTANCE_BLOCK) {
+            coord gap = order[j] - order[i];
+            if (gap * gap >= plbound(mergedChildren)) {
+                break;
+            }
+
+            size_t block = (count - j < DISTANCE_BLOCK) ? count - j : DISTANCE_BLOCK;
+            comparisons += block;
+            unsigned int mask = closerblock(p, psoffset(strip, j), block, plbound(mergedChildren), distances);
+            for (; mask != 0; mask &= mask - 1) {
+                size_t k = (size_t)__builtin_ctz(mask);
+                if (sides[i] != sides[j + k]) {
+                    pladd(mergedChildren, p, psget(strip, j + k), distances[k]);
+                }
+            }
+        }
+    }
+    return comparisons;
+}
+
+/**
+ * @brief Checks whether a coordinate lies within the strip of width delta around the split.
+ * @param coordinate The coordinate along the split axis you intend to check.
+ * @param divider The value the points were split at.
+ * @param best The squared best distance found so far, see plbound.
+ */
+int instrip(coord coordinate, coord divider, coord best) {
+    coord gap = coordinate - divider;
+    return gap * gap < best;
+}
+
+/**
+ * @brief Finds the closest points from the two sub problems.
+ * @details Collects the points within the best distance of the split, sorts them along the
+ * other axis and checks them with mergestrip, which takes O(n log n) time in total.
+ * The size of the strip and the number of comparisons end up in the trace node.
+ * @param points The point set of the upper sub problem, split by splitpoints.
+ * @param stored The amount of points stored in the point set.
+ * @param split The number of points that belong to the left sub problem.
+ * @param mergedChildren &mut Initially the merged pairs of the two sub problems.
+ * @param divider The value the points were split at.
+ * @param axis The axis along which you intend to merge the points.
+ * @param process The name of the current process.
+ */
+void mergefinal(pointset points, ssize_t stored, ssize_t split, pairlist *mergedChildren, coord divider, int axis,
+                const char *process) {
+
+    coord best = plbound(mergedChildren);
+    const coord *key = points.c[axis];
+    int other = (axis == SORT_AXIS) ? AXIS_X : SORT_AXIS;
+    size_t leftCount = 0;
+    size_t count = 0;
+
+    for (ssize_t i = 0; i < stored; ++i) {
+        if (instrip(key[i], divider, best)) {
+            leftCount += i < split;
+            count++;
+        }
+    }
+
+    traceNode.strip = count;
+    if (count < 2) {
+        return;
+    }
+
+    // The strip collects the left side in front of the right side, sorted receives both merged
+    pointset strip;
+    pointset sorted;
+    unsigned char *sides = malloc(count);
+    if (sides == NULL || psalloc(&strip, count) == -1 || psalloc(&sorted, count) == -1) {
+        error("Failed to allocate memory", process);
+    }
+
+    size_t l = 0;
+    size_t r = leftCount;
+    for (ssize_t i = 0; i < stored; ++i) {
+        if (instrip(key[i], divider, best)) {
+            psput(strip, (i < split) ? l++ : r++, psget(points, i));
+        }
+    }
+
+    sortpoints(strip, leftCount, other, sorted);
+    sortpoints(psoffset(strip, leftCount), count - leftCount, other, sorted);
+
+    const coord *order = strip.c[other];
+    l = 0;
+    r = leftCount;
+    for (size_t merged = 0; merged < count; merged++) {
+        int right = l == leftCount || (r < count && order[r] < order[l]);
+        psput(sorted, merged, psget(strip, right ? r++ : l++));
+        sides[merged] = (unsigned char)right;
+    }
+
+    traceNode.comparisons = mergestrip(sorted, sides, count, mergedChildren, other);
+    psfree(&strip);
+    psfree(&sorted);
+    free(sides);
+}
+
+/**
+ * @brief Finds the closest points from the two sub problems, whose points are already sorted by y.
+ * @details This is the textbook merge step of the in-process recursion. Both halves come back
+ * from the recursion sorted by y (SORT_AXIS), so the strip can be collected in order in O(n).
+ * Afterwards the halves are merged, so that the whole set is sorted by y for the caller.
+ * @param points &mut The points of the sub problem, both halves sorted by y.
+ * @param scratch &mut Scratch space for at least stored points.
+ * @param strip &mut Scratch space for at least stored strip points.
+ * @param sides &mut Scratch space for the sides of at least stored strip points.
+ * @param stored The amount of points stored in the point set.
+ * @param split The number of points that belong to the left sub problem.
+ * @param mergedChildren &mut Initially the merged pairs of the two sub problems.
+ * @param divider The value the points were split at.
+ * @param axis The axis along which the points were split.
+ */
+void mergesorted(pointset points, pointset scratch, pointset strip, unsigned char *sides, ssize_t stored,
+                 ssize_t split, pairlist *mergedChildren, coord divider, int axis) {
+    coord best = plbound(mergedChildren);
+    const coord *key = points.c[axis];
+    const coord *ys = points.c[SORT_AXIS];
+    ssize_t i = 0;
+    ssize_t j = split;
+    size_t count = 0;
+    size_t merged = 0;
+
+    while (i < split || j < stored) {
+        ssize_t next;
+        if (j >= stored || (i < split && ys[i] <= ys[j])) {
+            next = i++;
+        } else {
+            next = j++;
+        }
+
+        point p = psget(points, next);
+        psput(scratch, merged++, p);
+        if (instrip(key[next], divider, best)) {
+            psput(strip, count, p);
+            sides[count] = next >= split;
+            count++;
+        }
+    }
+
+    pscopy(points, 0, scratch, 0, stored);
+    mergestrip(strip, sides, count, mergedChildren, SORT_AXIS);
+}
+
+/**
+ * @brief Splits a point set in place around a value.
+ * @param points &mut The points you intend to split.
+ * @param stored The number of points stored in the point set.
+ * @param axis The axis along which you intend to split the points in two.
+ * @param mean The value to split at. Points less than or equal to it end up on the left.
+ * @return The number of points on the left, which are now stored at the front of the set.
+ */
+ssize_t partition(pointset points, ssize_t stored, int axis, coord mean) {
+    const coord *key = points.c[axis];
+    ssize_t left = 0;
+
+    for (ssize_t i = 0; i < stored; i++) {
+        if (key[i] <= mean) {
+            psswap(points, left, i);
+            left++;
+        }
+    }
+
+    return left;
+}
+
+/**
+ * @brief Rearranges a point set so that the point at index k is the one that would be there if
+ * the set was sorted along the given axis, like std::nth_element.
+ * @details Quickselect with random pivots and a three-way partition, so runs of equal coordinates
+ * do not degrade it. Takes linear time in expectation.
+ * @param points &mut The points you intend to rearrange.
+ * @param stored The number of points stored in the point set.
+ * @param k The index you intend to select, less than stored.
+ * @param axis The axis along which you intend to select.
+ * @return The coordinate of the selected point. All points in front of k are less than or equal
+ * to it, all points behind k are greater than or equal to it.
+ */
+coord selectpx(pointset points, ssize_t stored, ssize_t k, int axis) {
+    const coord *key = points.c[axis];
+    ssize_t lo = 0;
+    ssize_t hi = stored;
+    unsigned int seed = (unsigned int)stored;
+
+    while (hi - lo > 1) {
+        ssize_t p = lo + (ssize_t)(rand_r(&seed) % (hi - lo));
+        coord pivot = key[p];
+
+        // [lo, lt) < pivot, [lt, i) == pivot, [gt, hi) > pivot
+        ssize_t lt = lo;
+        ssize_t i = lo;
+        ssize_t gt = hi;
+        while (i < gt) {
+            if (key[i] < pivot) {
+                psswap(points, lt++, i++);
+            } else if (key[i] > pivot) {
+                psswap(points, --gt, i);
+            } else {
+                i++;
+            }
+        }
+
+        if (k < lt) {
+            hi = lt;
+        } else if (k >= gt) {
+            lo = gt;
+        } else {
+            break;
+        }
+    }
+
+    return key[k];
+}
+
+/**
+ * @brief Splits a point set in place into the two halves of the next recursion level.
+ * @details The median split always puts half of the points on each side, which bounds the depth
+ * of the recursion by log2(n). The mean split is kept for comparison; if rounding leaves one of its
+ * sides empty, the median split is used instead, as the recursion would never terminate otherwise.
+ * @param points &mut The points you intend to split.
+ * @param stored The number of points stored in the point set, at least 2.
+ * @param axis The axis along which you intend to split the points in two.
+ * @param mode The way the value to split at is chosen.
+ * @param divider &mut Receives the value the points were split at.
+ * @return The number of points on the left, which are now stored at the front of the set.
+ */
+ssize_t splitpoints(pointset points, ssize_t stored, int axis, splitmode mode, coord *divider) {
+    if (mode == SPLIT_MEAN) {
+        *divider = meanpx(points.c[axis], stored);
+        ssize_t split = partition(points, stored, axis, *divider);
+        if (split > 0 && split < stored) {
+            return split;
+        }
+    }
+
+    *divider = selectpx(points, stored, stored / 2, axis);
+    return stored / 2;
+}
+
+/**
+ * @brief Chooses the axis to split a sub problem along.
+ * @details Picks the axis the points are spread the most along, SORT_AXIS only if the points do
+ * not differ along any other axis, so that the strips can be scanned along SORT_AXIS. In the plane
+ * this means x unless all x coordinates are equal.
+ * @param points The points of the sub problem.
+ * @param stored The number of points stored in the point set, at least 2.
+ * @param axis &mut Receives the axis to split along.
+ * @return 1 if all points are identical and there is nothing to split, 0 otherwise.
+ */
+int splitaxis(pointset points, ssize_t stored, int *axis) {
+    coord widest = 0;
+    *axis = SORT_AXIS;
+
+    for (int a = 0; a < SORT_AXIS; a++) {
+        coord spread = coordinatespread(points.c[a], stored);
+        if (spread > widest) {
+            widest = spread;
+            *axis = a;
+        }
+    }
+
+    return *axis == SORT_AXIS && coordinatespread(points.c[SORT_AXIS], stored) == 0;
+}
+
+/**
+ * @brief Adds the pairs of a set of identical points to a list.
+ * @details All pairs have a distance of 0, so the first ones fill a list with a limit and
+ * a radius query gets every pair.
+ * @param points The identical points.
+ * @param stored The number of points stored in the point set.
+ * @param list &mut The list you intend to add to.
+ */
+void identicalpairs(pointset points, ssize_t stored, pairlist *list) {
+    point p = psget(points, 0);
+
+    for (ssize_t i = 0; i < stored; i++) {
+        for (ssize_t j = i + 1; j < stored; j++) {
+            if (list->limit != 0 && list->count == list->limit) {
+                return;
+            }
+            pladd(list, p, p, 0);
+        }
+    }
+}
+
+/**
+ * @brief Finds the closest pair of a small point set without splitting it.
+ * @details Sorts the points by y and compares every point with its successors until they are
+ * further than the bound of the list apart along y. This is O(n²) in the worst case, which is
+ * fine for the small sub problems it is meant for. The points are left sorted by y,
+ * as the in-process recursion expects from every sub problem.
+ * @param points &mut The points you intend to search. Their order is not preserved.
+ * @param stored The number of points stored in the point set, at least 2.
+ * @param scratch &mut Scratch space for at least stored points.
+ * @param pairs &mut An empty list that receives the closest pairs.
+ */
+void closestleaf(pointset points, ssize_t stored, pointset scratch, pairlist *pairs) {
+    sortpoints(points, stored, SORT_AXIS, scratch);
+
+    const coord *ys = points.c[SORT_AXIS];
+    coord distances[DISTANCE_BLOCK];
+
+    for (ssize_t i = 0; i < stored; i++) {
+        point p = psget(points, i);
+        for (ssize_t j = i + 1; j < stored; j += DISTANCE_BLOCK) {
+            coord gap = ys[j] - ys[i];
+            if (gap * gap >= plbound(pairs)) {
+                break;
+            }
+
+            size_t block = (stored - j < DISTANCE_BLOCK) ? (size_t)(stored - j) : DISTANCE_BLOCK;
+            unsigned int mask = closerblock(p, psoffset(points, j), block, plbound(pairs), distances);
+            for (; mask != 0; mask &= mask - 1) {
+                size_t k = (size_t)__builtin_ctz(mask);
+                pladd(pairs, p, psget(points, j + k), distances[k]);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Solves a sub problem of the process tree with closestleaf.
+ * @param points &mut The points you intend to search.
+ * @param stored The number of points stored in the point set, at least 2.
+ * @param pairs &mut An empty list that receives the closest pairs.
+ * @param process The name of the current process.
+ */
+void closestleafalloc(pointset points, ssize_t stored, pairlist *pairs, const char *process) {
+    pointset scratch;
+    if (psalloc(&scratch, stored) == -1) {
+        error("Failed to allocate memory", process);
+    }
+    closestleaf(points, stored, scratch, pairs);
+    psfree(&scratch);
+}
+
+/**
+ * A sub problem of the in-process recursion together with its result.
+ * pairs has to be an empty list when the sub problem is solved.
+ * scratch, strip and sides point to the same offset as points within buffers as large as the whole input,
+ * so sub problems running on different threads never share scratch space.
+ */
+typedef struct {
+    const options *opts;
+    pointset points;
+    pointset scratch;
+    pointset strip;
+    unsigned char *sides;
+    ssize_t stored;
+    pairlist pairs;
+} subproblem;
+
+/**
+ * @brief Solves a sub problem inside the current process.
+ * @details Follows the same steps as a process of the process tree: split the points with
+ * splitpoints, solve both halves, then merge their pairs with plmerge and check
+ * the points around the split with mergesorted. Large halves are handed to the
+ * pool so that idle threads can steal them. The points of the sub problem are sorted by y
+ * when it returns.
+ * @param self The worker executing the sub problem.
+ * @param arg &mut The subproblem you intend to solve.
+ */
+void solvesubproblem(poolworker *self, void *arg) {
+    subproblem *sp = arg;
+
+    if (sp->stored < 2) {
+        return;
+    }
+
+    if ((size_t)sp->stored <= sp->opts->leaf) {
+        closestleaf(sp->points, sp->stored, sp->scratch, &sp->pairs);
+        return;
+    }
+
+    int axis;
+
+    // Take care of the case when 2 (or more) points are identical
+    if (splitaxis(sp->points, sp->stored, &axis)) {
+        identicalpairs(sp->points, sp->stored, &sp->pairs);
+        return;
+    }
+
+    coord divider;
+    ssize_t split = splitpoints(sp->points, sp->stored, axis, sp->opts->split, &divider);
+
+    subproblem left = {
+        .opts = sp->opts, .points = sp->points, .scratch = sp->scratch, .strip = sp->strip,
+        .sides = sp->sides, .stored = split, .pairs = plempty(&sp->pairs)
+    };
+    subproblem right = {
+        .opts = sp->opts, .points = psoffset(sp->points, split), .scratch = psoffset(sp->scratch, split),
+        .strip = psoffset(sp->strip, split), .sides = sp->sides + split, .stored = sp->stored - split,
+        .pairs = plempty(&sp->pairs)
+    };
+
+    if (sp->stored >= SPAWN_GRAIN && poolsize(self) > 1) {
+        task leftTask = { .fn = solvesubproblem, .arg = &left };
+        poolspawn(self, &leftTask);
+        solvesubproblem(self, &right);
+        poolwait(self, &leftTask);
+    } else {
+        solvesubproblem(self, &left);
+        solvesubproblem(self, &right);
+    }
+
+    plmerge(&left.pairs, &right.pairs);
+    sp->pairs = left.pairs;
+    mergesorted(sp->points, sp->scratch, sp->strip, sp->sides, sp->stored, split, &sp->pairs, divider, axis);
+}
+
+/**
+ * @brief Solves a point set with the in-process recursion on a thread pool.
+ * @param points &mut The points you intend to search. Their order is not preserved.
+ * @param stored The number of points stored in the point set.
+ * @param opts The options of the current process.
+ * @param threads The number of threads, at least 1.
+ * @param pairs &mut An empty list that receives the closest pairs.
+ * @param process The name of the current process.
+ * @return 0 on success, -1 if the threads could not be created.
+ */
+int solverecursive(pointset points, ssize_t stored, const options *opts, size_t threads, pairlist *pairs,
+                   const char *process) {
+    pool *p = poolcreate(threads);
+    if (p == NULL) {
+        fprintf(stderr, "[%s] ERROR: Cannot create %zu threads\n", process, threads);
+        return -1;
+    }
+
+    pointset scratch;
+    pointset strip;
+    unsigned char *sides = malloc(stored);
+    if (sides == NULL || psalloc(&scratch, stored) == -1 || psalloc(&strip, stored) == -1) {
+        pooldestroy(p);
+        error("Failed to allocate memory", process);
+    }
+
+    subproblem root = {
+        .opts = opts, .points = points, .scratch = scratch, .strip = strip, .sides = sides, .stored = stored,
+        .pairs = plempty(pairs)
+    };
+    poolrun(p, solvesubproblem, &root);
+    pooldestroy(p);
+    psfree(&scratch);
+    psfree(&strip);
+    free(sides);
+
+    *pairs = root.pairs;
+    return 0;
+}
+
+/**
+ * @brief Solves the whole problem on a thread pool and prints the closest pairs to stdout.
+ * @param points &mut The points you intend to search. Their order is not preserved.
+ * @param stored The number of points stored in the point set.
+ * @param opts The options of the current process, opts->threads being the number of threads (1 if unset).
+ * @param process The name of the current process.
+ * @return EXIT_SUCCESS if everything worked fine else EXIT_FAILURE
+ */
+int solvethreaded(pointset points, ssize_t stored, const options *opts, const char *process) {
+    pairlist pairs = plinit(opts, process);
+    size_t threads = (opts->threads > 0) ? opts->threads : 1;
+    if (solverecursive(points, stored, opts, threads, &pairs, process) == -1) {
+        return EXIT_FAILURE;
+    }
+
+    printresult(opts, &pairs, process);
+    plfree(&pairs);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Returns the hash bucket of a grid cell.
+ * @details The cells are numbered row by row and wrapped around the buckets, so the right
+ * neighbour of a cell lands in the next bucket and the cells above in a single other run of
+ * buckets. Walking the buckets in order then only touches two places in memory at once, which
+ * is a lot faster than scattering the neighbours with a mixing hash.
+ * @param cx The column of the cell.
+ * @param cy The row of the cell.
+ * @param stride The number of columns of the grid, odd.
+ * @param mask The number of buckets - 1, the number of buckets being a power of 2.
+ */
+size_t gridbucket(int64_t cx, int64_t cy, uint64_t stride, size_t mask) {
+    return (size_t)((uint64_t)cx + (uint64_t)cy * stride) & mask;
+}
+
+/**
+ * @brief Finds the distance the grid engine uses as its cell size.
+ * @details Any pair of the input that belongs into the result is at most this far apart. A radius
+ * query knows it upfront. Otherwise it is the bound left by solving a random sample of n^(2/3)
+ * points with the recursion, as the pairs of the sample are pairs of the input as well. With
+ * this sample size a cell and its neighbours hold a constant number of points in expectation,
+ * whatever the distribution of the points (Rabin).
+ * @param points &mut The points of the problem, the sample is shuffled to their front.
+ * @param stored The number of points stored in the point set.
+ * @param opts The options of the current process.
+ * @param pairs An empty list for the query.
+ * @param process The name of the current process.
+ * @return The squared cell size, 0 or infinity if the grid cannot be used.
+ */
+coord gridcell(pointset points, ssize_t stored, const options *opts, const pairlist *pairs, const char *process) {
+    if (pairs->limit == 0) {
+        return pairs->bound;
+    }
+
+    size_t samples = (size_t)ceil(pow((double)stored, 2.0 / 3.0));
+    if (samples < 2) {
+        samples = 2;
+    }
+
+    // A partial Fisher-Yates shuffle draws the sample without picking a point twice
+    unsigned int seed = (unsigned int)stored;
+    for (size_t i = 0; i < samples; i++) {
+        size_t j = i + (size_t)rand_r(&seed) % (size_t)(stored - i);
+        psswap(points, i, j);
+    }
+
+    pairlist sample = plempty(pairs);
+    size_t threads = (opts->threads > 0) ? opts->threads : 1;
+    if (solverecursive(points, samples, opts, threads, &sample, process) == -1) {
+        return 0;
+    }
+
+    coord bound = plbound(&sample);
+    plfree(&sample);
+    return bound;
+}
+
+/**
+ * @brief Finds the closest pairs by hashing the points into a grid instead of splitting them.
+ * @details Uses a grid of cells as large as the distance found by gridcell, so every pair of the
+ * result lies in the same or in neighbouring cells. The points are bucketed by gridbucket of their
+ * cell with a counting sort and every point is only compared with the points of its own cell and
+ * half of its neighbours, so that every pair is looked at once. Takes O(n) time in expectation.
+ * @param points &mut The points you intend to search. Their order is not preserved.
+ * @param stored The number of points stored in the point set, at least 2.
+ * @param opts The options of the current process.
+ * @param pairs &mut An empty list that receives the closest pairs.
+ * @param process The name of the current process.
+ * @return 0 on success, -1 if the grid cannot be used for these points and the caller
+ * has to fall back to the recursion, e.g. because of duplicate points.
+ */
+int solvegrid(pointset points, ssize_t stored, const options *opts, pairlist *pairs, const char *process) {
+    if (AXES != 2) {
+        // The grid is only built for the plane
+        return -1;
+    }
+
+    coord bound = gridcell(points, stored, opts, pairs, process);
+    if (!(bound > 0) || !isfinite(bound)) {
+        return -1;
+    }
+
+    // Slightly larger than the bound, so that rounding never puts a pair of the result 2 cells apart
+    double cell = sqrt((double)bound) * 1.0001;
+    const coord *xs = points.c[AXIS_X];
+    const coord *ys = points.c[AXIS_Y];
+    coord minX = xs[0];
+    coord maxX = xs[0];
+    coord minY = ys[0];
+    coord maxY = ys[0];
+
+    for (ssize_t i = 1; i < stored; i++) {
+        minX = fmin(minX, xs[i]);
+        maxX = fmax(maxX, xs[i]);
+        minY = fmin(minY, ys[i]);
+        maxY = fmax(maxY, ys[i]);
+    }
+    if (((double)maxX - minX) / cell > 0x1p52 || ((double)maxY - minY) / cell > 0x1p52) {
+        return -1;
+    }
+
+    // One column more than needed keeps the stride odd, so a column of cells never shares a bucket
+    uint64_t stride = ((uint64_t)(((double)maxX - minX) / cell) + 1) | 1;
+    size_t buckets = 1;
+    while (buckets < GRID_LOAD * (size_t)stored) {
+        buckets *= 2;
+    }
+
+    int64_t *cells = malloc(sizeof(int64_t) * 2 * stored);
+    size_t *bucketOf = malloc(sizeof(size_t) * stored);
+    size_t *start = calloc(buckets + 1, sizeof(size_t));
+    int64_t *sortedCells = malloc(sizeof(int64_t) * 2 * stored);
+    pointset sorted;
+    if (cells == NULL || bucketOf == NULL || start == NULL || sortedCells == NULL ||
+        psalloc(&sorted, stored) == -1) {
+        error("Failed to allocate memory", process);
+    }
+
+    for (ssize_t i = 0; i < stored; i++) {
+        cells[2 * i] = (int64_t)floor(((double)xs[i] - minX) / cell);
+        cells[2 * i + 1] = (int64_t)floor(((double)ys[i] - minY) / cell);
+        bucketOf[i] = gridbucket(cells[2 * i], cells[2 * i + 1], stride, buckets - 1);
+        start[bucketOf[i] + 1]++;
+    }
+    for (size_t b = 0; b < buckets; b++) {
+        start[b + 1] += start[b];
+    }
+
+    // Counting sort by bucket, start[b] is used as the insert position and restored afterwards
+    for (ssize_t i = 0; i < stored; i++) {
+        size_t to = start[bucketOf[i]]++;
+        psput(sorted, to, psget(points, i));
+        sortedCells[2 * to] = cells[2 * i];
+        sortedCells[2 * to + 1] = cells[2 * i + 1];
+    }
+    for (size_t b = buckets; b > 0; b--) {
+        start[b] = start[b - 1];
+    }
+    start[0] = 0;
+
+    // The own cell and the neighbours in the upper half, the other half sees this cell in return
+    static const int neighbours[4][2] = { { 1, -1 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+
+    for (size_t b = 0; b < buckets; b++) {
+        for (size_t i = start[b]; i < start[b + 1]; i++) {
+            int64_t cx = sortedCells[2 * i];
+            int64_t cy = sortedCells[2 * i + 1];
+            point p = psget(sorted, i);
+
+            for (size_t j = i + 1; j < start[b + 1]; j++) {
+                if (sortedCells[2 * j] == cx && sortedCells[2 * j + 1] == cy) {
+                    point q = psget(sorted, j);
+                    pladd(pairs, p, q, sqdistance(p, q));
+                }
+            }
+
+            for (int n = 0; n < 4; n++) {
+                int64_t nx = cx + neighbours[n][0];
+                int64_t ny = cy + neighbours[n][1];
+                size_t nb = gridbucket(nx, ny, stride, buckets - 1);
+                for (size_t j = start[nb]; j < start[nb + 1]; j++) {
+                    if (sortedCells[2 * j] == nx && sortedCells[2 * j + 1] == ny) {
+                        point q = psget(sorted, j);
+                        pladd(pairs, p, q, sqdistance(p, q));
+                    }
+                }
+            }
+        }
+    }
+
+    psfree(&sorted);
+    free(sortedCells);
+    free(start);
+    free(bucketOf);
+    free(cells);
+    return 0;
+}
+
+/**
+ * Points that arrive one by one in --stream mode.
+ * Every point is known by an id, which indexes the arrays below. nn is the nearest neighbour a
+ * point had when it was inserted or when its previous nearest neighbour was deleted, and reverse
+ * lists the points that chose a point as their nearest neighbour. Later insertions do not update
+ * nn, which is fine: the later point of the closest pair always has the other one as its nn.
+ * The coordinates are indexed by a logarithmic family of static kd-trees (Bentley-Saxe):
+ * trees[i] holds at most 2^i points, an insertion merges the full trees in front of the first empty
+ * one, and deleted points stay in their tree until the next rebuild. Candidate pairs (a point and
+ * its nn) are kept in a min heap, outdated ones are dropped when they reach the top.
+ */
+typedef struct {
+    size_t *ids;
+    size_t count;
+    size_t capacity;
+} idlist;
+
+typedef struct {
+    pointset points;
+    size_t count;
+} kdtree;
+
+typedef struct {
+    coord distance;
+    size_t a;
+    size_t b;
+    uint64_t stamp;
+} candidate;
+
+typedef struct {
+    pointset coordinates;
+    size_t *nn;
+    coord *distance;
+    uint64_t *stamp;
+    unsigned char *alive;
+    idlist *reverse;
+    size_t capacity;
+    size_t used;
+    size_t live;
+    size_t dead;
+    idlist unused;
+    size_t **treeIds;
+    kdtree trees[STREAM_TREES];
+    candidate *heap;
+    size_t heapCount;
+    size_t heapCapacity;
+    unsigned int seed;
+    const char *process;
+} pointindex;
+
+/**
+ * @brief Appends an id to a list.
+ */
+void idpush(idlist *list, size_t id, const char *process) {
+    if (list->count == list->capacity) {
+        size_t capacity = (list->capacity == 0) ? 4 : list->capacity * 2;
+        size_t *tmp = realloc(list->ids, sizeof(size_t) * capacity);
+        if (tmp == NULL) {
+            error("Failed to allocate memory", process);
+        }
+        list->ids = tmp;
+        list->capacity = capacity;
+    }
+    list->ids[list->count++] = id;
+}
+
+/**
+ * @brief Records that a point chose another one as its nearest neighbour.
+ * @details Entries of points that have since chosen another neighbour are dropped whenever
+ * the list would have to grow, so the list stays proportional to its valid entries.
+ * @param index &mut The index of the stream.
+ * @param of The chosen neighbour.
+ * @param id The point that chose it.
+ */
+void reversepush(pointindex *index, size_t of, size_t id) {
+    idlist *list = &index->reverse[of];
+
+    if (list->count == list->capacity) {
+        size_t kept = 0;
+        for (size_t i = 0; i < list->count; i++) {
+            size_t other = list->ids[i];
+            if (index->alive[other] && index->nn[other] == of) {
+                list->ids[kept++] = other;
+            }
+        }
+        list->count = kept;
+    }
+    idpush(list, id, index->process);
+}
+
+/**
+ * @brief Adds a candidate pair to the heap of the index.
+ */
+void candidatepush(pointindex *index, candidate c) {
+    if (index->heapCount == index->heapCapacity) {
+        size_t capacity = (index->heapCapacity == 0) ? 64 : index->heapCapacity * 2;
+        candidate *tmp = realloc(index->heap, sizeof(candidate) * capacity);
+        if (tmp == NULL) {
+            error("Failed to allocate memory", index->process);
+        }
+        index->heap = tmp;
+        index->heapCapacity = capacity;
+    }
+
+    size_t i = index->heapCount++;
+    while (i > 0 && index->heap[(i - 1) / 2].distance > c.distance) {
+        index->heap[i] = index->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    index->heap[i] = c;
+}
+
+/**
+ * @brief Removes the closest candidate pair from the heap of the index.
+ */
+void candidatepop(pointindex *index) {
+    candidate last = index->heap[--index->heapCount];
+    size_t i = 0;
+
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= index->heapCount) {
+            break;
+        }
+        if (child + 1 < index->heapCount && index->heap[child + 1].distance < index->heap[child].distance) {
+            child++;
+        }
+        if (index->heap[child].distance >= last.distance) {
+            break;
+        }
+        index->heap[i] = index->heap[child];
+        i = child;
+    }
+    if (index->heapCount > 0) {
+        index->heap[i] = last;
+    }
+}
+
+/**
+ * @brief Checks whether a candidate pair still describes a point and its current nearest neighbour.
  */
-void usage(const char *process) {
-    fprintf(stderr, "[%s] ERROR: %s does not accept any arguments.\n", process, process);
-    exit(EXIT_FAILURE);
+int candidatevalid(const pointindex *index, const candidate *c) {
+    return index->alive[c->a] && index->stamp[c->a] == c->stamp;
 }
 
 /**
- * @brief Prints a point to a file.
- * @details It is assumed that both parameters are valid.
- * @param file The file you intend to write to.
- * @param p The point you intend to write to the file.
+ * @brief Rearranges ids so that the one at index k is the one that would be there if they were
+ * sorted by the given coordinates, like selectpx does for a point set.
  */
-int ptofile(FILE *file, point *p) {
-    return fprintf(file, "%.3f %.3f\n", p->x, p->y);
+void selectids(size_t *ids, const coord *key, size_t count, size_t k, unsigned int *seed) {
+    size_t lo = 0;
+    size_t hi = count;
+
+    while (hi - lo > 1) {
+        coord pivot = key[ids[lo + (size_t)rand_r(seed) % (hi - lo)]];
+
+        // [lo, lt) < pivot, [lt, i) == pivot, [gt, hi) > pivot
+        size_t lt = lo;
+        size_t i = lo;
+        size_t gt = hi;
+        while (i < gt) {
+            size_t id = ids[i];
+            if (key[id] < pivot) {
+                ids[i++] = ids[lt];
+                ids[lt++] = id;
+            } else if (key[id] > pivot) {
+                ids[i] = ids[--gt];
+                ids[gt] = id;
+            } else {
+                i++;
+            }
+        }
+
+        if (k < lt) {
+            hi = lt;
+        } else if (k >= gt) {
+            lo = gt;
+        } else {
+            break;
+        }
+    }
 }
 
 /**
- * @brief Returns the mean of the x values of a point array.
- * @details It is assumed that both parameters are valid.
- * @param points The point array you intend to calculate the mean of.
- * @param stored The amount of points in the point array.
- * @param axis The axis along which you intend to sort the points.
- * @details The axis parameter DOES NOT check for the validity of the input character.
- * It is highly advised that you double check it when using this function.
- */
-float meanpx(point *points, size_t stored, char axis) {
-    float sum = 0.0f;
-    for (size_t i = 0; i < stored; i++) {
-        sum += (axis == 'x') ? points[i].x : points[i].y;
+ * @brief Orders ids as an implicit kd-tree: the median of a range is its root, split along
+ * the axis given by the depth, and the halves in front of and behind it are its subtrees.
+ */
+void kdorder(pointindex *index, size_t *ids, size_t count, int axis) {
+    while (count > 1) {
+        size_t mid = count / 2;
+        selectids(ids, index->coordinates.c[axis], count, mid, &index->seed);
+        axis = (axis + 1) % AXES;
+        kdorder(index, ids, mid, axis);
+        ids += mid + 1;
+        count -= mid + 1;
     }
-    sum /= (float)stored;
-    return (float)sum;
 }
 
 /**
- * @brief Parses a string to a point.
- * @details Throws an error and exits if the string is not of a valid format.
- * @param input The string you intend to covert to a point.
- * @param process The name of the current process.
+ * @brief Finds the nearest point to p within a subtree of a kd-tree built by kdorder.
+ * @param tree The tree you intend to search.
+ * @param ids The ids of the points of the tree.
+ * @param lo The first index of the subtree.
+ * @param hi One past the last index of the subtree.
+ * @param axis The axis the root of the subtree splits along.
+ * @param p The point you intend to find the nearest neighbour of.
+ * @param exclude The id of p itself, which does not count as its neighbour.
+ * @param alive Whether the point with a given id has not been deleted.
+ * @param best &mut The id of the nearest point found so far.
+ * @param bestDistance &mut The squared distance to best.
  */
-point strtop(char *input, const char *process) {
-    point p;
+void kdnearest(const kdtree *tree, const size_t *ids, size_t lo, size_t hi, int axis, point p, size_t exclude,
+               const unsigned char *alive, size_t *best, coord *bestDistance) {
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        point q = psget(tree->points, mid);
+        coord distance = sqdistance(p, q);
+
+        if (distance < *bestDistance && ids[mid] != exclude && alive[ids[mid]]) {
+            *best = ids[mid];
+            *bestDistance = distance;
+        }
 
-    char *x_str = strtok(input, " ");
-    char *y_str = strtok(NULL, "\n");
+        coord gap = p.c[axis] - q.c[axis];
+        int next = (axis + 1) % AXES;
 
-    if (x_str == NULL || y_str == NULL) {
-        error("Malformed input line", process);
+        // Descend into the side of p first, the other side only has to be searched if it is close enough
+        if (gap < 0) {
+            kdnearest(tree, ids, lo, mid, next, p, exclude, alive, best, bestDistance);
+            if (gap * gap >= *bestDistance) {
+                return;
+            }
+            lo = mid + 1;
+        } else {
+            kdnearest(tree, ids, mid + 1, hi, next, p, exclude, alive, best, bestDistance);
+            if (gap * gap >= *bestDistance) {
+                return;
+            }
+            hi = mid;
+        }
+        axis = next;
     }
+}
+
+/**
+ * @brief Finds the nearest live point to p over all trees of the index.
+ * @param index The index you intend to search.
+ * @param p The point you intend to find the nearest neighbour of.
+ * @param exclude The id of p itself or SIZE_MAX.
+ * @param distance &mut Receives the squared distance to the nearest point.
+ * @return The id of the nearest point or SIZE_MAX if there is none.
+ */
+size_t indexnearest(const pointindex *index, point p, size_t exclude, coord *distance) {
+    size_t best = SIZE_MAX;
+    *distance = INFINITY;
 
-    char *endptr_x;
-    p.x = strtof(x_str, &endptr_x);
+    for (int i = 0; i < STREAM_TREES; i++) {
+        const kdtree *tree = &index->trees[i];
+        kdnearest(tree, index->treeIds[i], 0, tree->count, AXIS_X, p, exclude, index->alive, &best, distance);
+    }
+    return best;
+}
 
-    char *endptr_y;
-    p.y = strtof(y_str, &endptr_y);
+/**
+ * @brief Builds trees[slot] from the given ids.
+ * @details Deleted points among the ids are dropped for good and their ids can be used again.
+ */
+void indexbuild(pointindex *index, int slot, size_t *ids, size_t count) {
+    size_t kept = 0;
 
-    if (*endptr_x != '\0') {
-        error("Malformed input line", process);
+    for (size_t i = 0; i < count; i++) {
+        if (index->alive[ids[i]]) {
+            ids[kept++] = ids[i];
+        } else {
+            idpush(&index->unused, ids[i], index->process);
+            index->dead--;
+        }
     }
 
-    if (*endptr_y != '\0') {
-        error("Malformed input line", process);
+    kdorder(index, ids, kept, AXIS_X);
+
+    kdtree *tree = &index->trees[slot];
+    psfree(&tree->points);
+    if (psalloc(&tree->points, kept) == -1) {
+        error("Failed to allocate memory", index->process);
+    }
+    for (size_t i = 0; i < kept; i++) {
+        psput(tree->points, i, psget(index->coordinates, ids[i]));
     }
+    tree->count = kept;
 
-    return p;
+    free(index->treeIds[slot]);
+    index->treeIds[slot] = ids;
 }
 
 /**
- * @brief Closes all ends of both child pipe
- * @details It is assumed that all necessary file descriptor duplications were done prior to calling this function
- * @param rightReadPipe The right parent read pipe that you intend to close.
- * @param leftReadPipe The left parent read pipe that you intend to close.
- * @param rightWritePipe The left parent write pipe that you intend to close.
- * @param leftWritePipe The left parent write pipe that you intend to close.
+ * @brief Merges trees[0] up to trees[last] and the given ids into trees[last].
+ * @param index &mut The index of the stream.
+ * @param last The slot of the merged tree.
+ * @param extra An id to add or SIZE_MAX.
  */
-void closepipes(int rightReadPipe[2], int leftReadPipe[2], int rightWritePipe[2], int leftWritePipe[2]) {
-    close(rightReadPipe[0]);
-    close(rightReadPipe[1]);
-    close(rightWritePipe[0]);
-    close(rightWritePipe[1]);
-    close(leftReadPipe[0]);
-    close(leftWritePipe[1]);
-    close(leftReadPipe[1]);
-    close(leftWritePipe[0]);
+void indexmerge(pointindex *index, int last, size_t extra) {
+    size_t count = (extra != SIZE_MAX);
+    for (int i = 0; i <= last; i++) {
+        count += index->trees[i].count;
+    }
+
+    size_t *ids = malloc(sizeof(size_t) * (count > 0 ? count : 1));
+    if (ids == NULL) {
+        error("Failed to allocate memory", index->process);
+    }
+
+    count = 0;
+    if (extra != SIZE_MAX) {
+        ids[count++] = extra;
+    }
+    for (int i = 0; i <= last; i++) {
+        memcpy(ids + count, index->treeIds[i], sizeof(size_t) * index->trees[i].count);
+        count += index->trees[i].count;
+        if (i != last) {
+            index->trees[i].count = 0;
+        }
+    }
+
+    indexbuild(index, last, ids, count);
 }
 
 /**
- * @brief Converts standard in to a point array.
- * @details Dynamically allocates memory to store the points.
- * @param points &mut A pointer to an UNINITIALISED point array.
- * @param process The name of the current process.
- * @return A signed size that indicates the size of the array
- * -1 if it was unable to allocate memory.
+ * @brief Returns an unused id, growing the arrays of the index if necessary.
  */
-ssize_t stdintopa(point **points, const char *process)
-{
-    ssize_t stored = 0;
-    size_t capacity = 2;
-    *points = malloc(sizeof(point) * capacity);
-
-    if (points == NULL)
-    {
-        error("Failed to allocate memory", process);
+size_t indexid(pointindex *index) {
+    if (index->unused.count > 0) {
+        return index->unused.ids[--index->unused.count];
     }
 
-    char *line = NULL;
-    size_t linelen = 0;
-    while (getline(&line, &linelen, stdin) != -1)
-    {
-        // Resize
-        if (capacity == stored)
-        {
-            capacity *= 2;
-            point *tmp = realloc(*points, sizeof(point) * capacity);
-            if (tmp == NULL)
-            {
-                free(line);
-                free(*points);
-                error("Failed to allocate memory", process);
-            }
-            *points = tmp;
+    if (index->used == index->capacity) {
+        size_t capacity = (index->capacity == 0) ? 1024 : index->capacity * 2;
+        pointset coordinates;
+        if (psalloc(&coordinates, capacity) == -1) {
+            error("Failed to allocate memory", index->process);
         }
+        pscopy(coordinates, 0, index->coordinates, 0, index->used);
+        psfree(&index->coordinates);
+        index->coordinates = coordinates;
 
-        point p = strtop(line, process);
-        (*points)[stored] = p;
-        stored++;
+        size_t *nn = realloc(index->nn, sizeof(size_t) * capacity);
+        if (nn != NULL) {
+            index->nn = nn;
+        }
+        coord *distance = realloc(index->distance, sizeof(coord) * capacity);
+        if (distance != NULL) {
+            index->distance = distance;
+        }
+        uint64_t *stamp = realloc(index->stamp, sizeof(uint64_t) * capacity);
+        if (stamp != NULL) {
+            index->stamp = stamp;
+        }
+        unsigned char *alive = realloc(index->alive, capacity);
+        if (alive != NULL) {
+            index->alive = alive;
+        }
+        idlist *reverse = realloc(index->reverse, sizeof(idlist) * capacity);
+        if (reverse != NULL) {
+            index->reverse = reverse;
+        }
+        if (nn == NULL || distance == NULL || stamp == NULL || alive == NULL || reverse == NULL) {
+            error("Failed to allocate memory", index->process);
+        }
+        index->capacity = capacity;
     }
 
-    free(line);
-    return stored;
+    size_t id = index->used++;
+    index->stamp[id] = 0;
+    index->reverse[id] = (idlist){ .ids = NULL, .count = 0, .capacity = 0 };
+    return id;
 }
 
 /**
- * @brief Converts child output to an array of (max) 2 points.
- * @param file The file to which the child has written its output.
- * @param points &mut An INITIALISED array of 2 points.
- * @param process The name of the current process.
- * @return An unsigned size that indicates the amount of points written.
+ * @brief Looks up the nearest neighbour of a point and offers the pair as a candidate.
  */
-size_t ctop(FILE *file, point points[2], const char *process) {
-
-    size_t stored = 0;
-    size_t size = 0;
-    char *line = NULL;
+void indexneighbour(pointindex *index, size_t id) {
+    point p = psget(index->coordinates, id);
 
-    while((getline(&line, &size, file)) != -1) {
-        points[stored] = strtop(line, process);
-        stored++;
+    index->stamp[id]++;
+    index->nn[id] = indexnearest(index, p, id, &index->distance[id]);
+    if (index->nn[id] == SIZE_MAX) {
+        return;
     }
-    free(line);
-    return stored;
+
+    reversepush(index, index->nn[id], id);
+    candidate c = { .distance = index->distance[id], .a = id, .b = index->nn[id], .stamp = index->stamp[id] };
+    candidatepush(index, c);
 }
 
 /**
- * @brief A function that calculates the euclidean distance of 2 points.
- * @param p1 Point one
- * @param p2 Point two
- * @return The euclidean distance of of the aforementioned points.
+ * @brief Inserts a point into the index.
+ * @details Takes O(log² n) amortized time: the nearest neighbour query visits O(log n) trees
+ * and every point is part of O(log n) rebuilds, which take O(log n) time per point each.
  */
-float euclidean(point p1, point p2) {
-    return sqrtf((float)(pow(p2.x - p1.x, 2) + pow(p2.y - p1.y, 2)));
+void indexinsert(pointindex *index, point p) {
+    size_t id = indexid(index);
+    psput(index->coordinates, id, p);
+    index->alive[id] = 1;
+    index->live++;
+
+    indexneighbour(index, id);
+
+    // The first tree that can take the point together with all trees in front of it
+    int slot = 0;
+    size_t total = 1 + index->trees[0].count;
+    while (slot < STREAM_TREES - 1 && total > ((size_t)1 << slot)) {
+        slot++;
+        total += index->trees[slot].count;
+    }
+    indexmerge(index, slot, id);
 }
 
 /**
- * @brief Prints a pair of points to a given file.
- * @param file The file you intend to print to.
- * @param pair &mut An array of exactly 2 points.
+ * @brief Deletes a point with the given coordinates from the index.
+ * @details Only the points that chose the deleted one as their nearest neighbour look for a new one.
+ * All trees are merged into one once they hold more deleted than live points.
+ * @return 0 on success, -1 if there is no such point.
  */
-void printpairsorted(FILE *file, point pair[2], const char *process) {
-    int result;
-
-    if ((pair[0].x == pair[1].x && pair[0].y <= pair[1].y) ||
-        (pair[0].x < pair[1].x)) {
-        result = ptofile(file, &pair[0]);
-        if (result == -1) {
-            error("Error writing to file", process);
-        }
+int indexdelete(pointindex *index, point p) {
+    coord distance;
+    size_t id = indexnearest(index, p, SIZE_MAX, &distance);
+    if (id == SIZE_MAX || distance != 0) {
+        return -1;
+    }
 
-        result = ptofile(file, &pair[1]);
-        if (result == -1) {
-            error("Error writing to file", process);
-        }
-    } else {
-        result = ptofile(file, &pair[1]);
-        if (result == -1) {
-            error("Error writing to file", process);
+    index->alive[id] = 0;
+    index->stamp[id]++;
+    index->live--;
+    index->dead++;
+
+    idlist reverse = index->reverse[id];
+    index->reverse[id] = (idlist){ .ids = NULL, .count = 0, .capacity = 0 };
+    for (size_t i = 0; i < reverse.count; i++) {
+        size_t other = reverse.ids[i];
+        if (index->alive[other] && index->nn[other] == id) {
+            indexneighbour(index, other);
         }
+    }
+    free(reverse.ids);
 
-        result = ptofile(file, &pair[0]);
-        if (result == -1) {
-            error("Error writing to file", process);
-        }
+    if (index->dead > index->live) {
+        indexmerge(index, STREAM_TREES - 1, SIZE_MAX);
     }
+    return 0;
 }
 
 /**
- * @brief Sends points to 2 child processes.
- * @param points The points you intend to send to a child process.
- * @param stored The number of points stored in the points array.
- * @param axis The axis along which you intend to split the points in two.
- * @param leftWriteFile The file descriptor of the left child.
- * @param rightWriteFile The file descriptor of the right child.
+ * @brief Returns the closest pair of the index.
+ * @param index &mut The index of the stream.
+ * @param pair &mut An array of 2 points that receives the closest pair.
+ * @return 0 on success, -1 if there are fewer than 2 points.
  */
-void ptoc(point *points, ssize_t stored, char axis, FILE *leftWriteFile, FILE *rightWriteFile) {
-    float mean = meanpx(points, stored, axis);
+int indexclosest(pointindex *index, point pair[2]) {
+    while (index->heapCount > 0 && !candidatevalid(index, &index->heap[0])) {
+        candidatepop(index);
+    }
+    if (index->heapCount == 0) {
+        return -1;
+    }
 
-    for (int i = 0; i < stored; i++) {
-        if ((axis == 'x' && points[i].x <= mean) || (axis == 'y' && points[i].y <= mean)) {
-            ptofile(leftWriteFile, &points[i]);
-        } else {
-            ptofile(rightWriteFile, &points[i]);
+    // Outdated candidates pile up with many deletions, start over from the current ones
+    if (index->heapCount > 4 * index->live + 64) {
+        size_t count = index->heapCount;
+        index->heapCount = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (candidatevalid(index, &index->heap[i])) {
+                candidate c = index->heap[i];
+                candidatepush(index, c);
+            }
         }
     }
+
+    pair[0] = psget(index->coordinates, index->heap[0].a);
+    pair[1] = psget(index->coordinates, index->heap[0].b);
+    return 0;
 }
 
 /**
- * @brief Counts the number of coordinates that are identical*.
- * @details The function does not count ALL identical coordinates.
- * @param points The array of points of which you wish to count the identical* coordinates of.
- * @param stored The number of points stored in the points array.
- * @param axis The axis along which you intend to count the identical* coordinates.
- * @return The number of identical* coordinates.
+ * @brief Releases everything the index holds.
  */
-int countcoordinates(point *points, ssize_t stored, char axis) {
-    int count = 0;
-    float sameCoordinate = (axis == 'x') ? points[0].x : points[0].y;
-
-    for (size_t i = 0; i < stored; i++) {
-        if ((axis == 'x' && points[i].x == sameCoordinate) ||
-            (axis == 'y' && points[i].y == sameCoordinate)) {
-            count++;
-        }
+void indexfree(pointindex *index) {
+    for (size_t i = 0; i < index->used; i++) {
+        free(index->reverse[i].ids);
+    }
+    for (int i = 0; i < STREAM_TREES; i++) {
+        psfree(&index->trees[i].points);
+        free(index->treeIds[i]);
     }
+    psfree(&index->coordinates);
+    free(index->treeIds);
+    free(index->nn);
+    free(index->distance);
+    free(index->stamp);
+    free(index->alive);
+    free(index->reverse);
+    free(index->unused.ids);
+    free(index->heap);
+}
+
+/**
+ * @brief Prints the current closest pair of the stream followed by an empty line.
+ */
+void printstream(pointindex *index, const char *process) {
+    point pair[2];
 
-    return count;
+    if (indexclosest(index, pair) == 0) {
+        printpairsorted(stdout, pair, process);
+    }
+    if (fputc('\n', stdout) == EOF || fflush(stdout) == EOF) {
+        error("Error writing to file", process);
+    }
 }
 
 /**
- * @brief Finds the closest points from the two sub problems.
- * @param points The array of points of the upper sub problem.
- * @param stored The amount of points stored in the points array.
- * @param mergedChildren &mut Initially an array of points of the better pair of the two sub problems.
- * @param mean The mean of the points array.
- * @param axis The axis along which you intend to merge the points.
+ * @brief Keeps the closest pair of a stream of points up to date.
+ * @details Reads stdin line by line: "x y" or "+ x y" inserts a point, "- x y" deletes a point
+ * with exactly these coordinates. An empty line ends a batch and prints the current closest pair,
+ * followed by an empty line, as does the end of the input after a non-empty batch.
+ * @param process The name of the current process.
+ * @return EXIT_SUCCESS if everything worked fine else EXIT_FAILURE
  */
-void mergefinal(point *points, ssize_t stored, point mergedChildren[2], float mean, char axis) {
+int streampoints(const char *process) {
+    pointindex index = { .process = process, .seed = 1 };
+    index.treeIds = calloc(STREAM_TREES, sizeof(size_t *));
+    if (index.treeIds == NULL) {
+        error("Failed to allocate memory", process);
+    }
 
-    float delta = euclidean(mergedChildren[0], mergedChildren[1]);
-    int storedLeftSide = 0;
-    point leftSide[stored];
+    char *line = NULL;
+    size_t linelen = 0;
+    ssize_t length;
+    int pending = 0;
 
-    for (ssize_t i = 0; i < stored; ++i) {
-        // Check if point is on the left side and within the delta region based on the specified axis
-        if ((axis == 'x' && points[i].x < mean && (points[i].x + delta) > mean) ||
-            (axis == 'y' && points[i].y < mean && (points[i].y + delta) > mean)) {
-            leftSide[storedLeftSide] = points[i];
-            storedLeftSide += 1;
+    while ((length = getline(&line, &linelen, stdin)) != -1) {
+        char *end = line + length;
+        if (end > line && end[-1] == '\n') {
+            end--;
         }
-    }
 
-    for (ssize_t j = 0; j < stored; ++j) {
-        if ((axis == 'x' && points[j].x < mean) || (axis == 'y' && points[j].y < mean) ||
-            (axis == 'x' && points[j].x - mean > delta) || (axis == 'y' && points[j].y - mean > delta)) {
-            // Skip all irrelevant points based on the specified axis
+        if (end == line) {
+            printstream(&index, process);
+            pending = 0;
             continue;
         }
 
-        for (int k = 0; k < storedLeftSide; ++k) {
-            float delta2 = euclidean(points[j], leftSide[k]);
-            if (delta2 < delta) {
-                delta = delta2;
-                mergedChildren[0] = points[j];
-                mergedChildren[1] = leftSide[k];
+        pending = 1;
+        if ((line[0] == '+' || line[0] == '-') && end - line > 1 && line[1] == ' ') {
+            point p = mtop(line + 2, end, process);
+            if (line[0] == '+') {
+                indexinsert(&index, p);
+            } else if (indexdelete(&index, p) == -1) {
+                fprintf(stderr, "[%s] WARNING: Cannot delete a point that does not exist: ", process);
+                ptofile(stderr, &p);
             }
+        } else {
+            indexinsert(&index, mtop(line, end, process));
         }
     }
+
+    if (pending) {
+        printstream(&index, process);
+    }
+
+    free(line);
+    indexfree(&index);
+    return EXIT_SUCCESS;
 }
 
 /**
- * @brief Finds the better pair of from the 2 children.
- * @param child1Points The points from the first child.
- * @param a The amount of points from the first child.
- * @param child2Points The points from the second child.
- * @param b The amount of points from the first child.
- * @param mergedChildren &mut An initially empty array of points.
- * @return -1 if both children failed 0 if everything worked fine.
+ * @brief Parses a strictly positive number given as an option argument.
+ * @param arg The option argument.
+ * @param process The name of the current process.
+ * @return The parsed number. Exits with a usage message on invalid input.
  */
-int mergechildren(point child1Points[2], size_t a, point child2Points[2], size_t b, point mergedChildren[2]) {
-    if (a == 0  && b == 0) {
-        return -1;
+size_t strtocount(const char *arg, const char *process) {
+    char *endptr;
+    errno = 0;
+    long value = strtol(arg, &endptr, 10);
+
+    if (errno != 0 || endptr == arg || *endptr != '\0' || value <= 0) {
+        fprintf(stderr, "[%s] ERROR: Invalid number '%s'\n", process, arg);
+        usage(process);
     }
 
-    if (a == 0)
-    {
-        mergedChildren[0] = child2Points[0];
-        mergedChildren[1] = child2Points[1];
-        return 0;
+    return (size_t)value;
+}
+
+/**
+ * @brief Parses a finite, non-negative distance given as an option argument.
+ * @param arg The option argument.
+ * @param process The name of the current process.
+ * @return The parsed distance. Exits with a usage message on invalid input.
+ */
+coord strtoradius(const char *arg, const char *process) {
+    char *endptr;
+    errno = 0;
+    coord value = strtocoord(arg, &endptr);
+
+    if (errno != 0 || endptr == arg || *endptr != '\0' || !isfinite(value) || value < 0) {
+        fprintf(stderr, "[%s] ERROR: Invalid radius '%s'\n", process, arg);
+        usage(process);
     }
 
-    if (b == 0)
-    {
-        mergedChildren[0] = child1Points[0];
-        mergedChildren[1] = child1Points[1];
-        return 0;
+    return value;
+}
+
+/**
+ * @brief Checks whether the current process solves its points in-process instead of forking.
+ * @details With --jobs P only the top ceil(log2 P) levels of the tree fork, so the tree has at least P
+ * and less than 2P processes at the bottom and at most 4P processes in total, no matter how many points
+ * there are. Without --jobs only --threads keeps the points in the first process.
+ * @param opts The options of the current process.
+ */
+int solveinprocess(const options *opts) {
+    if (opts->jobs == 0) {
+        return opts->threads > 0;
     }
+    return opts->depth >= sizeof(size_t) * CHAR_BIT - 1 || ((size_t)1 << opts->depth) >= opts->jobs;
+}
 
-    if (euclidean(child1Points[0], child1Points[1]) <=
-        euclidean(child2Points[0], child2Points[1]))
-    {
-        mergedChildren[0] = child1Points[0];
-        mergedChildren[1] = child1Points[1];
-        return 0;
+/**
+ * @brief Replaces the current process with a new cpair child that uses the same options.
+ * @details Only returns if exec failed.
+ * @param opts The options you intend to pass on to the child.
+ * @param process The name of the current process.
+ */
+void execchild(const options *opts, const char *process) {
+    char leaf[32];
+    snprintf(leaf, sizeof(leaf), "%zu", opts->leaf);
+
+    char depth[32];
+    snprintf(depth, sizeof(depth), "%zu", opts->depth + 1);
+
+    char jobs[32];
+    snprintf(jobs, sizeof(jobs), "%zu", opts->jobs);
+
+    char threads[32];
+    snprintf(threads, sizeof(threads), "%zu", opts->threads);
+
+    char region[32];
+    snprintf(region, sizeof(region), "%d", regionFd);
+
+    char query[32];
+    if (opts->radius >= 0) {
+        snprintf(query, sizeof(query), COORD_EXACT, opts->radius);
     } else {
-        mergedChildren[0] = child2Points[0];
-        mergedChildren[1] = child2Points[1];
-        return 0;
+        snprintf(query, sizeof(query), "%zu", opts->pairs);
+    }
+
+    const char *argv[16];
+    int argc = 0;
+    argv[argc++] = process;
+    argv[argc++] = "--child";
+    argv[argc++] = "--depth";
+    argv[argc++] = depth;
+    argv[argc++] = "--leaf";
+    argv[argc++] = leaf;
+    argv[argc++] = "--split";
+    argv[argc++] = (opts->split == SPLIT_MEAN) ? "mean" : "median";
+    argv[argc++] = (opts->radius >= 0) ? "--radius" : "--pairs";
+    argv[argc++] = query;
+    if (opts->trace != NULL) {
+        argv[argc++] = "--trace";
+        argv[argc++] = opts->trace;
+    }
+    if (regionFd != -1) {
+        argv[argc++] = "--region";
+        argv[argc++] = region;
     }
+    if (opts->jobs > 0) {
+        argv[argc++] = "--jobs";
+        argv[argc++] = jobs;
+        if (opts->threads > 0) {
+            argv[argc++] = "--threads";
+            argv[argc++] = threads;
+        }
+    }
+    argv[argc] = NULL;
+
+    execvp(process, (char *const *)argv);
 }
 
 /**
@@ -359,45 +2658,206 @@ int mergechildren(point child1Points[2], size_t a, point child2Points[2], size_t
 int main(int argc, char *argv[]) {
 
     const char *process = argv[0];
-    if (argc != 1) {
+    options opts = { .threads = 0, .jobs = 0, .leaf = DEFAULT_LEAF_SIZE, .split = SPLIT_MEDIAN, .algo = ALGO_DIVIDE, .pairs = 1,
+                     .radius = -1.0f, .stream = 0, .shm = 0, .trace = NULL, .depth = 0 };
+    int pairsGiven = 0;
+
+    statsFile = getenv("CPAIR_STATS");
+    if (statsFile != NULL && *statsFile != '\0') {
+        atexit(writestats);
+    }
+
+    static struct option longOptions[] = {
+        { "threads", required_argument, NULL, 't' },
+        { "jobs", required_argument, NULL, 'j' },
+        { "leaf", required_argument, NULL, 'l' },
+        { "split", required_argument, NULL, 's' },
+        { "algo", required_argument, NULL, 'a' },
+        { "pairs", required_argument, NULL, 'k' },
+        { "radius", required_argument, NULL, 'r' },
+        { "stream", no_argument, NULL, 'S' },
+        { "trace", required_argument, NULL, 'T' },
+        { "shm", no_argument, NULL, 'M' },
+        { "child", no_argument, NULL, 'c' },
+        { "depth", required_argument, NULL, 'd' },
+        { "region", required_argument, NULL, 'R' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "t:j:l:s:a:k:r:", longOptions, NULL)) != -1) {
+        switch (opt) {
+            case 't':
+                opts.threads = strtocount(optarg, process);
+                break;
+            case 'j':
+                opts.jobs = strtocount(optarg, process);
+                break;
+            case 'l':
+                opts.leaf = strtocount(optarg, process);
+                if (opts.leaf < 2) {
+                    fprintf(stderr, "[%s] ERROR: The leaf size has to be at least 2\n", process);
+                    usage(process);
+                }
+                break;
+            case 's':
+                if (strcmp(optarg, "median") == 0) {
+                    opts.split = SPLIT_MEDIAN;
+                } else if (strcmp(optarg, "mean") == 0) {
+                    opts.split = SPLIT_MEAN;
+                } else {
+                    fprintf(stderr, "[%s] ERROR: Unknown split '%s'\n", process, optarg);
+                    usage(process);
+                }
+                break;
+            case 'a':
+                if (strcmp(optarg, "divide") == 0) {
+                    opts.algo = ALGO_DIVIDE;
+                } else if (strcmp(optarg, "grid") == 0) {
+                    opts.algo = ALGO_GRID;
+                } else {
+                    fprintf(stderr, "[%s] ERROR: Unknown algorithm '%s'\n", process, optarg);
+                    usage(process);
+                }
+                break;
+            case 'k':
+                opts.pairs = strtocount(optarg, process);
+                pairsGiven = 1;
+                break;
+            case 'r':
+                opts.radius = strtoradius(optarg, process);
+                break;
+            case 'S':
+                opts.stream = 1;
+                break;
+            case 'T':
+                opts.trace = optarg;
+                break;
+            case 'M':
+                opts.shm = 1;
+                break;
+            case 'c':
+                // internal: stdin and stdout carry frames from and to the parent
+                opts.child = 1;
+                break;
+            case 'd':
+                // internal: the depth of the child in the process tree
+                opts.depth = strtocount(optarg, process);
+                break;
+            case 'R':
+                // internal: the descriptor of the shared memory region of --shm
+                regionFd = (int)strtocount(optarg, process);
+                break;
+            default:
+                usage(process);
+        }
+    }
+
+    if (optind != argc) {
+        usage(process);
+    }
+
+    if (pairsGiven && opts.radius >= 0) {
+        fprintf(stderr, "[%s] ERROR: --pairs and --radius cannot be combined\n", process);
         usage(process);
     }
 
-    point *points;
-    ssize_t stored = stdintopa(&points, process);
+    if (opts.stream) {
+        if (pairsGiven || opts.radius >= 0) {
+            fprintf(stderr, "[%s] ERROR: --stream only keeps the closest pair\n", process);
+            usage(process);
+        }
+        exit(streampoints(process));
+    }
+
+    if (opts.trace != NULL) {
+        traceopen(opts.trace, opts.depth, process);
+    }
+
+    double phase = tracenow(CLOCK_MONOTONIC);
+    pointset points;
+    ssize_t stored;
+    if (opts.child) {
+        stored = (regionFd != -1) ? regiontopa(regionFd, stdin, &points, process) : readframe(stdin, &points, process);
+    } else {
+        stored = inputtopa(&points, process);
+    }
+    pairlist pairs = plinit(&opts, process);
+    traceNode.stored = stored;
+    traceevent("read", phase, "");
 
     switch (stored) {
         case 0:
             fprintf(stderr, "[%s] ERROR: No points provided via stdin!\n", process);
-            free(points);
+            releasepoints(&points);
             exit(EXIT_FAILURE);
             break;
         case 1:
-            free(points);
+            printresult(&opts, &pairs, process);
+            releasepoints(&points);
             exit(EXIT_SUCCESS);
             break;
-        case 2:
-            printpairsorted(stdout, points, process);
-            fflush(stdout);
-            free(points);
-            exit(EXIT_SUCCESS);
         default:
             break;
     }
 
-    int sameX = countcoordinates(points, stored, 'x');
-    int sameY = countcoordinates(points, stored, 'y');
-    point samePoints[2];
+    if ((size_t)stored <= opts.leaf) {
+        closestleafalloc(points, stored, &pairs, process);
+        printresult(&opts, &pairs, process);
+        plfree(&pairs);
+        releasepoints(&points);
+        exit(EXIT_SUCCESS);
+    }
+
+    traceNode.kind = "grid";
+    if (opts.algo == ALGO_GRID) {
+        if (solvegrid(points, stored, &opts, &pairs, process) == 0) {
+            printresult(&opts, &pairs, process);
+            plfree(&pairs);
+            releasepoints(&points);
+            exit(EXIT_SUCCESS);
+        }
+        // The grid declined, e.g. for duplicate points, the recursion takes over in-process
+        traceNode.kind = "threads";
+        plfree(&pairs);
+        int status = solvethreaded(points, stored, &opts, process);
+        releasepoints(&points);
+        exit(status);
+    }
+
+    traceNode.kind = "threads";
+    if (solveinprocess(&opts)) {
+        int status = solvethreaded(points, stored, &opts, process);
+        releasepoints(&points);
+        exit(status);
+    }
+
+    int axis;
 
     // Take care of the case when 2 (or more) points are identical
-    if (sameX == stored && sameY == stored) {
-        samePoints[0] = points[0];
-        samePoints[1] = points[1];
-        printpairsorted(stdout, samePoints, process);
-        free(points);
+    phase = tracenow(CLOCK_MONOTONIC);
+    if (splitaxis(points, stored, &axis)) {
+        traceNode.kind = "identical";
+        identicalpairs(points, stored, &pairs);
+        printresult(&opts, &pairs, process);
+        plfree(&pairs);
+        releasepoints(&points);
         exit(EXIT_SUCCESS);
     }
 
+    coord divider;
+    ssize_t split = splitpoints(points, stored, axis, opts.split, &divider);
+    traceNode.kind = "split";
+    traceNode.axis = axis;
+    traceNode.divider = divider;
+    traceNode.split = split;
+    traceevent("split", phase, "");
+
+    // Only the first process copies the points into the region, its children work on it in place
+    if (opts.shm && regionFd == -1) {
+        regionalloc(&points, stored, process);
+    }
+
     // Parent writes to this
     int leftWritePipe[2];
     int rightWritePipe[2];
@@ -410,33 +2870,34 @@ int main(int argc, char *argv[]) {
         pipe(leftReadPipe) == -1 || pipe(rightReadPipe) == -1)
     {
         fprintf(stderr, "[%s] ERROR: Cannot pipe\n", process);
-        free(points);
+        releasepoints(&points);
         exit(EXIT_FAILURE);
     }
 
+    double forked = tracenow(CLOCK_MONOTONIC);
     pid_t leftChild = fork();
 
     if (leftChild == -1) {
         fprintf(stderr, "[%s] ERROR: Cannot fork\n", process);
         closepipes(rightReadPipe, leftReadPipe, rightWritePipe, leftWritePipe);
-        free(points);
+        releasepoints(&points);
         exit(EXIT_FAILURE);
     }
 
     if (leftChild == 0) {
         // 1 is the write end of a pipe
         // 0 is the read end of a pipe
+        // The child leaves with _exit, the atexit handlers of the stats and the trace belong to the parent
         if (dup2(leftReadPipe[1], STDOUT_FILENO) == -1 ||
             dup2(leftWritePipe[0], STDIN_FILENO) == -1) {
-            error("Error duplicating pipes", process);
-            exit(EXIT_FAILURE);
+            fprintf(stderr, "[%s] ERROR: Cannot duplicate pipes: %s\n", process, strerror(errno));
+            _exit(EXIT_FAILURE);
         }
         closepipes(rightReadPipe, leftReadPipe, rightWritePipe, leftWritePipe);
-        execlp(process, process, NULL);
+        execchild(&opts, process);
 
         fprintf(stderr, "[%s] ERROR: Cannot exec: %s\n", process, strerror(errno));
-        free(points);
-        exit(EXIT_FAILURE);
+        _exit(EXIT_FAILURE);
     }
 
     pid_t rightChild = fork();
@@ -444,25 +2905,25 @@ int main(int argc, char *argv[]) {
     if (rightChild == -1) {
         fprintf(stderr, "[%s] ERROR: Cannot fork\n", process);
         closepipes(rightReadPipe, leftReadPipe, rightWritePipe, leftWritePipe);
-        free(points);
+        releasepoints(&points);
         exit(EXIT_FAILURE);
     }
 
     if (rightChild == 0) {
         // 1 is the write end of a pipe
         // 0 is the read end of a pipe
+        // The child leaves with _exit, the atexit handlers of the stats and the trace belong to the parent
         if (dup2(rightReadPipe[1], STDOUT_FILENO) == -1 ||
             dup2(rightWritePipe[0], STDIN_FILENO) == -1) {
-            error("Error duplicating pipes", process);
-            exit(EXIT_FAILURE);
+            fprintf(stderr, "[%s] ERROR: Cannot duplicate pipes: %s\n", process, strerror(errno));
+            _exit(EXIT_FAILURE);
         }
 
         closepipes(rightReadPipe, leftReadPipe, rightWritePipe, leftWritePipe);
-        execlp(process, process, NULL);
+        execchild(&opts, process);
 
         fprintf(stderr, "[%s] ERROR: Cannot exec: %s\n", process, strerror(errno));
-        free(points);
-        exit(EXIT_FAILURE);
+        _exit(EXIT_FAILURE);
     }
     // 1 is the write end of a pipe
     // 0 is the read end of a pipe
@@ -485,7 +2946,7 @@ int main(int argc, char *argv[]) {
         rightReadFile == NULL || rightWriteFile == NULL)
     {
         fprintf(stderr, "[%s] ERROR: Cannot create file descriptor: %s\n", process, strerror(errno));
-        free(points);
+        releasepoints(&points);
 
         close(leftWritePipe[1]);
         close(rightWritePipe[1]);
@@ -498,52 +2959,63 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
-    (sameX == stored) ?
-    ptoc(points, stored, 'y', leftWriteFile, rightWriteFile):
-    ptoc(points, stored, 'x', leftWriteFile, rightWriteFile);
+    phase = tracenow(CLOCK_MONOTONIC);
+    int sent;
+    if (regionFd != -1) {
+        sent = writerange(leftWriteFile, regionOffset, split) == -1 ? -1 :
+               writerange(rightWriteFile, regionOffset + split, stored - split);
+    } else {
+        sent = ptoc(points, stored, split, leftWriteFile, rightWriteFile);
+    }
+    if (sent == -1) {
+        fprintf(stderr, "[%s] ERROR: Cannot write to child: %s\n", process, strerror(errno));
+    }
 
     fflush(leftWriteFile);
     fflush(rightWriteFile);
     fclose(leftWriteFile);
     fclose(rightWriteFile);
+    traceevent("send", phase, "");
 
+    // The answers have to be read before waiting, a child blocks until a large answer is read
     int statusLeft, statusRight;
+    pairlist rightPairs = plempty(&pairs);
+    int received = readpairs(leftReadFile, &pairs);
+    if (readpairs(rightReadFile, &rightPairs) == -1) {
+        received = -1;
+    }
+
     waitpid(leftChild, &statusLeft, 0);
+    traceNode.leftWait = tracenow(CLOCK_MONOTONIC) - forked;
     waitpid(rightChild, &statusRight, 0);
-
-    if (WEXITSTATUS(statusLeft) == EXIT_FAILURE) {
-        free(points);
+    traceNode.rightWait = tracenow(CLOCK_MONOTONIC) - forked;
+    traceevent("children", forked, "");
+
+    // A failed child explains its missing output better than the output itself
+    int failed = childfailed("left", statusLeft, process);
+    failed |= childfailed("right", statusRight, process);
+    if (failed) {
+        releasepoints(&points);
         exit(EXIT_FAILURE);
     }
-    if (WEXITSTATUS(statusRight) == EXIT_FAILURE) {
-        free(points);
-        exit(EXIT_FAILURE);
+    if (received == -1) {
+        releasepoints(&points);
+        error("Malformed child output", process);
     }
 
-    point child1Points[2];
-    point child2Points[2];
-    point mergedChildren[2];
-
-    size_t a = ctop(leftReadFile, child1Points, process);
-    size_t b = ctop(rightReadFile, child2Points, process);
-
-    close(leftWritePipe[1]);
-    close(rightWritePipe[1]);
-    close(leftReadPipe[0]);
-    close(rightReadPipe[0]);
-
-    char axis = (sameX == stored) ? 'y' : 'x';
-    float mean = meanpx(points, stored, axis);
-
-    if ((mergechildren(child1Points, a, child2Points, b, mergedChildren)) != 0) {
-        free(points);
-        exit(EXIT_FAILURE);
-    }
+    fclose(leftReadFile);
+    fclose(rightReadFile);
 
-    mergefinal(points, stored, mergedChildren, mean, axis);
+    phase = tracenow(CLOCK_MONOTONIC);
+    plmerge(&pairs, &rightPairs);
+    mergefinal(points, stored, split, &pairs, divider, axis, process);
+    traceevent("merge", phase, "");
 
-    printpairsorted(stdout, mergedChildren, process);
+    phase = tracenow(CLOCK_MONOTONIC);
+    printresult(&opts, &pairs, process);
+    traceevent("write", phase, "");
 
-    free(points);
+    plfree(&pairs);
+    releasepoints(&points);
     return EXIT_SUCCESS;
 }
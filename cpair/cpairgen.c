@@ -0,0 +1,194 @@
+/**
+ * @file cpairgen.c
+ * @author Ivan Cankov 12219400 <e12219400@student.tuwien.ac.at>
+ * @date 05.11.2023
+ * @brief Generates point sets in the input format of cpair for benchmarks.
+ **/
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "stdint.h"
+#include "math.h"
+#include "unistd.h"
+
+/**
+ * The side length of the cube the points are generated in.
+ */
+#define EXTENT (1e6)
+
+/**
+ * The number of clusters of the clustered distribution.
+ */
+#define CLUSTERS (32)
+
+/**
+ * The most coordinates a point can have, the same limit as the DIMENSIONS of cpair.
+ */
+#define MAX_DIMENSIONS (8)
+
+typedef struct {
+    const char *name;
+    const char *description;
+} distribution;
+
+static const distribution distributions[] = {
+    { "uniform", "evenly spread over a cube" },
+    { "clustered", "gaussian blobs around a few centres" },
+    { "collinear", "all on one diagonal line" },
+    { "duplicates", "only about sqrt(n) distinct points, repeated" },
+    { "adversarial", "heavy-tailed first axis, which skews mean splits and makes the grid very fine" },
+};
+
+#define DISTRIBUTIONS (sizeof(distributions) / sizeof(distributions[0]))
+
+/**
+ * @brief Print a usage message to stderr and exit the process with EXIT_FAILURE.
+ * @param process The name of the current process.
+ */
+void usage(const char *process) {
+    fprintf(stderr, "Usage: %s [-d DIMENSIONS] DISTRIBUTION COUNT [SEED]\n", process);
+    for (size_t i = 0; i < DISTRIBUTIONS; i++) {
+        fprintf(stderr, "  %-12s %s\n", distributions[i].name, distributions[i].description);
+    }
+    fprintf(stderr, "COUNT may use exponent notation, e.g. 1e6. DIMENSIONS is 2 to %d (default 2)\n"
+            "and has to match the DIMENSIONS cpair was built with.\n", MAX_DIMENSIONS);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Returns the next number of a xorshift64* generator.
+ * @details The generator is part of the program so that a seed gives the same points everywhere.
+ * @param state &mut The state of the generator, never 0.
+ */
+uint64_t nextrandom(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1Dull;
+}
+
+/**
+ * @brief Returns a uniformly distributed number in (0, 1].
+ */
+double uniform(uint64_t *state) {
+    return ((nextrandom(state) >> 11) + 1) * 0x1p-53;
+}
+
+/**
+ * @brief Returns a normally distributed number with mean 0 and standard deviation 1 (Box-Muller).
+ */
+double gaussian(uint64_t *state) {
+    return sqrt(-2.0 * log(uniform(state))) * cos(2.0 * M_PI * uniform(state));
+}
+
+/**
+ * @brief The entrypoint of the program.
+ * @param argc
+ * @param argv
+ * @return EXIT_SUCCESS if everything worked fine else EXIT_FAILURE
+ */
+int main(int argc, char *argv[]) {
+    const char *process = argv[0];
+    long dimensions = 2;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:")) != -1) {
+        switch (opt) {
+            case 'd': {
+                char *endptr;
+                dimensions = strtol(optarg, &endptr, 10);
+                if (endptr == optarg || *endptr != '\0' || dimensions < 2 || dimensions > MAX_DIMENSIONS) {
+                    usage(process);
+                }
+                break;
+            }
+            default:
+                usage(process);
+        }
+    }
+
+    if (argc - optind != 2 && argc - optind != 3) {
+        usage(process);
+    }
+
+    size_t kind = DISTRIBUTIONS;
+    for (size_t i = 0; i < DISTRIBUTIONS; i++) {
+        if (strcmp(argv[optind], distributions[i].name) == 0) {
+            kind = i;
+        }
+    }
+
+    char *endptr;
+    double count = strtod(argv[optind + 1], &endptr);
+    if (kind == DISTRIBUTIONS || *endptr != '\0' || !(count >= 1.0) || count > 1e12) {
+        usage(process);
+    }
+
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    if (argc - optind == 3) {
+        state ^= strtoull(argv[optind + 2], NULL, 10) * 0xBF58476D1CE4E5B9ull;
+    }
+    if (state == 0) {
+        state = 1;
+    }
+
+    double centres[CLUSTERS][MAX_DIMENSIONS];
+    for (size_t i = 0; i < CLUSTERS; i++) {
+        for (long k = 0; k < dimensions; k++) {
+            centres[i][k] = uniform(&state) * EXTENT;
+        }
+    }
+
+    size_t n = (size_t)count;
+    size_t distinct = (size_t)sqrt((double)n) + 1;
+
+    // The axes are drawn in order, so the 2D points of a seed stay the same as before -d
+    for (size_t i = 0; i < n; i++) {
+        double c[MAX_DIMENSIONS];
+
+        switch (kind) {
+            case 0:
+                for (long k = 0; k < dimensions; k++) {
+                    c[k] = uniform(&state) * EXTENT;
+                }
+                break;
+            case 1: {
+                size_t cluster = nextrandom(&state) % CLUSTERS;
+                for (long k = 0; k < dimensions; k++) {
+                    c[k] = centres[cluster][k] + gaussian(&state) * EXTENT / 1000.0;
+                }
+                break;
+            }
+            case 2:
+                c[0] = uniform(&state) * EXTENT;
+                for (long k = 1; k < dimensions; k++) {
+                    c[k] = 0.5 * k * c[0] + 3.0 * k;
+                }
+                break;
+            case 3: {
+                // The same seed for the same index gives the same point every time it is drawn
+                uint64_t pick = (nextrandom(&state) % distinct) * 0x9E3779B97F4A7C15ull + 1;
+                for (long k = 0; k < dimensions; k++) {
+                    c[k] = uniform(&pick) * EXTENT;
+                }
+                break;
+            }
+            default:
+                c[0] = fmin(1.0 / pow(uniform(&state), 3.0), 1e30);
+                for (long k = 1; k < dimensions; k++) {
+                    c[k] = uniform(&state);
+                }
+                break;
+        }
+
+        for (long k = 0; k < dimensions; k++) {
+            if (printf((k + 1 < dimensions) ? "%.9g " : "%.9g\n", (float)c[k]) < 0) {
+                fprintf(stderr, "[%s] ERROR: Cannot write points\n", process);
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,261 @@
+/**
+ * @file pool.c
+ * @author Ivan Cankov 12219400 <e12219400@student.tuwien.ac.at>
+ * @date 05.11.2023
+ * @brief A small work-stealing thread pool for fork/join recursion.
+ **/
+
+#include "stdlib.h"
+#include "pthread.h"
+#include "sched.h"
+#include "pool.h"
+
+struct poolworker {
+    pool *owner;
+    size_t id;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    task **tasks;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+    unsigned int seed;
+};
+
+struct pool {
+    poolworker *workers;
+    size_t count;
+    size_t started;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    size_t pending;
+    int stop;
+};
+
+/**
+ * @brief Takes the most recently pushed task of the worker's own deque.
+ * @param self The worker whose deque you intend to pop from.
+ * @return The task or NULL if the deque is empty.
+ */
+static task *popown(poolworker *self) {
+    task *t = NULL;
+    pthread_mutex_lock(&self->lock);
+    if (self->tail > self->head) {
+        self->tail--;
+        t = self->tasks[self->tail % self->capacity];
+    }
+    pthread_mutex_unlock(&self->lock);
+    return t;
+}
+
+/**
+ * @brief Takes the oldest task of another worker's deque.
+ * @details Old tasks are the ones closest to the root of the recursion,
+ * which makes them the largest ones and the most worthwhile to steal.
+ * @param victim The worker you intend to steal from.
+ * @return The task or NULL if the deque is empty.
+ */
+static task *steal(poolworker *victim) {
+    task *t = NULL;
+    pthread_mutex_lock(&victim->lock);
+    if (victim->tail > victim->head) {
+        t = victim->tasks[victim->head % victim->capacity];
+        victim->head++;
+    }
+    pthread_mutex_unlock(&victim->lock);
+    return t;
+}
+
+/**
+ * @brief Finds a task to execute, preferring the worker's own deque.
+ * @param self The worker looking for work.
+ * @return The task or NULL if no deque holds a task.
+ */
+static task *findtask(poolworker *self) {
+    pool *p = self->owner;
+    task *t = popown(self);
+
+    if (t == NULL && p->count > 1) {
+        size_t start = (size_t)rand_r(&self->seed) % p->count;
+        for (size_t i = 0; i < p->count && t == NULL; i++) {
+            size_t victim = (start + i) % p->count;
+            if (victim != self->id) {
+                t = steal(&p->workers[victim]);
+            }
+        }
+    }
+
+    if (t != NULL) {
+        __atomic_sub_fetch(&p->pending, 1, __ATOMIC_SEQ_CST);
+    }
+    return t;
+}
+
+/**
+ * @brief Executes a task and marks it as done.
+ * @param self The worker executing the task.
+ * @param t The task you intend to execute.
+ */
+static void execute(poolworker *self, task *t) {
+    t->fn(self, t->arg);
+    __atomic_store_n(&t->done, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief The main loop of every additional worker thread.
+ * @param arg The worker the thread belongs to.
+ */
+static void *workerloop(void *arg) {
+    poolworker *self = arg;
+    pool *p = self->owner;
+
+    for (;;) {
+        task *t = findtask(self);
+        if (t != NULL) {
+            execute(self, t);
+            continue;
+        }
+
+        pthread_mutex_lock(&p->lock);
+        while (!p->stop && __atomic_load_n(&p->pending, __ATOMIC_SEQ_CST) == 0) {
+            pthread_cond_wait(&p->wake, &p->lock);
+        }
+        int stop = p->stop;
+        pthread_mutex_unlock(&p->lock);
+
+        if (stop) {
+            return NULL;
+        }
+    }
+}
+
+pool *poolcreate(size_t threads) {
+    if (threads == 0) {
+        return NULL;
+    }
+
+    pool *p = calloc(1, sizeof(pool));
+    if (p == NULL) {
+        return NULL;
+    }
+
+    p->workers = calloc(threads, sizeof(poolworker));
+    if (p->workers == NULL) {
+        free(p);
+        return NULL;
+    }
+
+    p->count = threads;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wake, NULL);
+
+    for (size_t i = 0; i < threads; i++) {
+        poolworker *w = &p->workers[i];
+        w->owner = p;
+        w->id = i;
+        w->seed = (unsigned int)i * 2654435761u + 1;
+        w->capacity = 64;
+        pthread_mutex_init(&w->lock, NULL);
+    }
+
+    // worker 0 is the thread calling poolrun
+    p->started = 1;
+    for (size_t i = 0; i < threads; i++) {
+        poolworker *w = &p->workers[i];
+        w->tasks = malloc(sizeof(task *) * w->capacity);
+        if (w->tasks == NULL) {
+            pooldestroy(p);
+            return NULL;
+        }
+    }
+
+    for (size_t i = 1; i < threads; i++) {
+        if (pthread_create(&p->workers[i].thread, NULL, workerloop, &p->workers[i]) != 0) {
+            break;
+        }
+        p->started++;
+    }
+
+    if (p->started != threads) {
+        pooldestroy(p);
+        return NULL;
+    }
+
+    return p;
+}
+
+void pooldestroy(pool *p) {
+    if (p == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&p->lock);
+    p->stop = 1;
+    pthread_cond_broadcast(&p->wake);
+    pthread_mutex_unlock(&p->lock);
+
+    for (size_t i = 1; i < p->started; i++) {
+        pthread_join(p->workers[i].thread, NULL);
+    }
+
+    for (size_t i = 0; i < p->count; i++) {
+        free(p->workers[i].tasks);
+        pthread_mutex_destroy(&p->workers[i].lock);
+    }
+
+    pthread_cond_destroy(&p->wake);
+    pthread_mutex_destroy(&p->lock);
+    free(p->workers);
+    free(p);
+}
+
+void poolrun(pool *p, taskfn fn, void *arg) {
+    fn(&p->workers[0], arg);
+}
+
+void poolspawn(poolworker *self, task *t) {
+    pool *p = self->owner;
+    t->done = 0;
+
+    pthread_mutex_lock(&self->lock);
+    if (self->tail - self->head == self->capacity) {
+        size_t capacity = self->capacity * 2;
+        task **tmp = malloc(sizeof(task *) * capacity);
+        if (tmp == NULL) {
+            pthread_mutex_unlock(&self->lock);
+            // Nobody else can see the task yet, so it is fine to just run it here
+            execute(self, t);
+            return;
+        }
+        for (size_t i = self->head; i < self->tail; i++) {
+            tmp[i % capacity] = self->tasks[i % self->capacity];
+        }
+        free(self->tasks);
+        self->tasks = tmp;
+        self->capacity = capacity;
+    }
+    // Count the task before anyone can steal it, so pending never underflows
+    __atomic_add_fetch(&p->pending, 1, __ATOMIC_SEQ_CST);
+    self->tasks[self->tail % self->capacity] = t;
+    self->tail++;
+    pthread_mutex_unlock(&self->lock);
+
+    pthread_mutex_lock(&p->lock);
+    pthread_cond_signal(&p->wake);
+    pthread_mutex_unlock(&p->lock);
+}
+
+void poolwait(poolworker *self, task *t) {
+    while (!__atomic_load_n(&t->done, __ATOMIC_ACQUIRE)) {
+        task *other = findtask(self);
+        if (other != NULL) {
+            execute(self, other);
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+size_t poolsize(poolworker *self) {
+    return self->owner->count;
+}
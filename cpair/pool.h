@@ -0,0 +1,72 @@
+/**
+ * @file pool.h
+ * @author Ivan Cankov 12219400 <e12219400@student.tuwien.ac.at>
+ * @date 05.11.2023
+ * @brief A small work-stealing thread pool for fork/join recursion.
+ * @details Every worker owns a deque of tasks. A worker pushes and pops at the
+ * tail of its own deque and steals from the head of the other deques when its
+ * own one runs dry. A worker that waits for a task keeps executing other tasks
+ * until the awaited one is done, so nested fork/join never blocks a thread.
+ **/
+
+#ifndef OSVU_POOL_H
+#define OSVU_POOL_H
+
+#include "stddef.h"
+
+typedef struct pool pool;
+typedef struct poolworker poolworker;
+
+typedef void (*taskfn)(poolworker *self, void *arg);
+
+typedef struct {
+    taskfn fn;
+    void *arg;
+    int done;
+} task;
+
+/**
+ * @brief Creates a pool with the given amount of workers.
+ * @details The calling thread becomes worker 0 while inside poolrun,
+ * so only threads - 1 additional threads are started.
+ * @param threads The total amount of workers, at least 1.
+ * @return The pool or NULL if it could not be created.
+ */
+pool *poolcreate(size_t threads);
+
+/**
+ * @brief Stops all workers and releases the pool.
+ * @param p The pool you intend to destroy.
+ */
+void pooldestroy(pool *p);
+
+/**
+ * @brief Runs fn on the calling thread as worker 0 and returns once it has finished.
+ * @param p The pool that executes spawned subtasks.
+ * @param fn The root task.
+ * @param arg The argument of the root task.
+ */
+void poolrun(pool *p, taskfn fn, void *arg);
+
+/**
+ * @brief Makes a task available to the pool.
+ * @details The task has to stay valid until poolwait has returned for it.
+ * @param self The worker that spawns the task.
+ * @param t &mut The task you intend to spawn.
+ */
+void poolspawn(poolworker *self, task *t);
+
+/**
+ * @brief Waits until the given task is done while executing other tasks.
+ * @param self The worker that spawned the task.
+ * @param t The task you intend to wait for.
+ */
+void poolwait(poolworker *self, task *t);
+
+/**
+ * @brief Returns the amount of workers of the pool the worker belongs to.
+ * @param self Any worker of the pool.
+ */
+size_t poolsize(poolworker *self);
+
+#endif //OSVU_POOL_H
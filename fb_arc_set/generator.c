@@ -10,11 +10,58 @@
 #include "utils.h"
 static int shmFd = -1;
 static cbuf *buf = NULL;
-static sem_t *semUsed = NULL;
-static sem_t *semFree = NULL;
-static sem_t *semMutex = NULL;
+static size_t bufBytes = 0;
 static size_t num_of_edges;
 static size_t num_of_vertices;
+static size_t batch_size;
+static bool local_search = false;
+static bool exact = false;
+
+/**
+ * The graph in compressed sparse rows with 32 bit vertex ids: the successors of vertex v are
+ * out_list[out_start[v]] to out_list[out_start[v + 1] - 1]. Only the local search needs the
+ * predecessors, which are stored the same way.
+ */
+static size_t *out_start = NULL;
+static uint32_t *out_list = NULL;
+static size_t *in_start = NULL;
+static uint32_t *in_list = NULL;
+
+/**
+ * The strongly connected components with more than one vertex. An edge between two components
+ * never lies on a cycle, so the graph above only keeps the edges within them. Every ordering
+ * gives component c the positions comp_start[c] to comp_start[c + 1] - 1, and comp_vertices
+ * lists the vertices of one component after the other. The other vertices have no edges left.
+ */
+static size_t num_of_components = 0;
+static size_t *comp_start = NULL;
+static uint32_t *comp_vertices = NULL;
+
+/**
+ * The self loops of the graph. Each of them is a cycle of its own, so every solution
+ * removes all of them, and the search over the components leaves them out.
+ */
+static edge *self_loops = NULL;
+static size_t num_of_self_loops = 0;
+
+/**
+ * A generator thread. The threads only share the graph and the mapping of the shared buffer,
+ * everything they change while generating candidates is their own.
+ */
+typedef struct {
+    pthread_t thread;
+    uint64_t rng[4];
+    uint32_t *permutation;
+    uint32_t *order;
+    uint32_t *scratch;
+    size_t *comp_cost;
+    uint32_t *out_mark;
+    uint32_t *in_mark;
+    edge_list pending[MAX_WRITE_BATCH];
+    size_t num_of_pending;
+    long num_of_skipped;
+    size_t last_size;
+} worker;
 
 static const char* PROGRAM_NAME;
 
@@ -56,7 +103,14 @@ static void ERROR_EXIT(char *message, char *error_details) {
  * and then exits the program with a failure status using the exit(EXIT_FAILURE) call.
  */
 static void USAGE() {
-    fprintf(stderr, "Usage: %s EDGE1 EDGE2 ...\n", PROGRAM_NAME);
+    fprintf(stderr, "Usage: %s [-b batch] [-t threads] EDGE1 EDGE2 ...\n", PROGRAM_NAME);
+    fprintf(stderr, "  -b batch    publish candidates in batches of this many (default %d, at most %d)\n",
+            DEFAULT_WRITE_BATCH, MAX_WRITE_BATCH);
+    fprintf(stderr, "  -t threads  generate candidates on this many threads (default 1, at most %d)\n",
+            MAX_GENERATOR_THREADS);
+    fprintf(stderr, "  -l          improve every ordering with a local search before it is checked\n");
+    fprintf(stderr, "  -e          find an optimal solution, for strongly connected components of up to %d vertices\n",
+            EXACT_MAX_VERTICES);
     fprintf(stderr, "Example: %s 0-1 1-2 1-3 1-4 2-4 3-6 4-3 4-5 6-0\n", PROGRAM_NAME);
     exit(EXIT_FAILURE);
 }
@@ -65,12 +119,12 @@ static void USAGE() {
  * @brief Perform cleanup operations on program shutdown.
  *
  * This function decrements the number of generators in the shared buffer,
- * unmaps shared memory, closes file descriptors, and closes semaphores.
+ * unmaps shared memory and closes file descriptors.
  */
 static void shutdown() {
     if (buf != NULL) {
-        buf->numOfGenerators--;
-        if (munmap(buf, sizeof(*buf)) < 0) {
+        __atomic_sub_fetch(&buf->numOfGenerators, 1, __ATOMIC_SEQ_CST);
+        if (munmap(buf, bufBytes) < 0) {
             ERROR_MSG("Error unmapping shared memory", strerror(errno));
         }
     }
@@ -80,151 +134,760 @@ static void shutdown() {
             ERROR_MSG("Error closing shared memory fd", strerror(errno));
         }
     }
+}
 
-    if (semUsed != NULL) {
-        if (sem_close(semUsed) < 0) {
-            ERROR_MSG("Error closing used", strerror(errno));
+/**
+ * @brief Wait until the supervisor has read a slot in the previous lap of the buffer.
+ *
+ * This function sleeps on the `freed` futex of the shared buffer while the buffer
+ * is full. It does not exit on termination, the other threads of the generator
+ * still use the mapping of the buffer.
+ *
+ * @param s The slot the generator reserved.
+ * @param pos The position the generator reserved.
+ * @return true if the program is flagged for termination, false otherwise.
+ */
+static bool writeWait(slot *s, uint64_t pos) {
+    unsigned int freed = __atomic_load_n(&buf->freed, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&buf->writersWaiting, 1, __ATOMIC_SEQ_CST);
+
+    // The supervisor may have freed the slot before it could see writersWaiting,
+    // otherwise futexWait returns right away as soon as freed changed
+    if ((int64_t)(__atomic_load_n(&s->sequence, __ATOMIC_SEQ_CST) - pos) < 0 &&
+        !__atomic_load_n(&buf->terminate, __ATOMIC_SEQ_CST)) {
+        if (futexWait(&buf->freed, freed) < 0 && errno != EAGAIN && errno != EINTR) {
+            ERROR_EXIT("Error while waiting for free", strerror(errno));
         }
     }
 
-    if (semFree != NULL) {
-        if (sem_close(semFree) < 0) {
-            ERROR_MSG("Error closing free", strerror(errno));
+    __atomic_sub_fetch(&buf->writersWaiting, 1, __ATOMIC_SEQ_CST);
+    return __atomic_load_n(&buf->terminate, __ATOMIC_SEQ_CST) != 0;
+}
+
+/**
+ * @brief Signal that slots of the shared buffer are written.
+ *
+ * This function tells the supervisor that slots were published and only wakes
+ * it up if it is sleeping on the `published` futex.
+ */
+static void writeSignal() {
+    __atomic_add_fetch(&buf->published, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&buf->readerWaiting, __ATOMIC_SEQ_CST) && futexWake(&buf->published, 1) < 0) {
+        ERROR_EXIT("Error while waking the supervisor", strerror(errno));
+    }
+}
+
+/**
+ * @brief Write edge_lists to consecutive slots of the shared buffer.
+ *
+ * This function reserves count positions of the shared buffer with a single
+ * compare and swap on `writePos`, waits if the buffer is full, writes the
+ * `edge_list`s to the slots and publishes them with a single signal.
+ * Generators never block each other.
+ *
+ * The supervisor frees the slots in order, so once the slot of the last
+ * position is free for this lap, the slots of all positions before it are too.
+ * If the program is flagged for termination meanwhile, nothing is written.
+ *
+ * @param candidates The edge_lists to be written to the shared buffer.
+ * @param count The number of edge_lists, at most the capacity of the buffer.
+ */
+static void bufferWrite(const edge_list candidates[], size_t count) {
+    uint64_t pos = __atomic_load_n(&buf->writePos, __ATOMIC_RELAXED);
+
+    for (;;) {
+        uint64_t last = pos + count - 1;
+        slot *s = &buf->data[last % buf->capacity];
+        int64_t turn = (int64_t)(__atomic_load_n(&s->sequence, __ATOMIC_ACQUIRE) - last);
+
+        if (turn == 0) {
+            // On failure pos is updated to the current writePos
+            if (__atomic_compare_exchange_n(&buf->writePos, &pos, pos + count, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (turn < 0) {
+            // The slot still holds a candidate of the previous lap, the buffer is full
+            if (writeWait(s, last)) {
+                return;
+            }
+            pos = __atomic_load_n(&buf->writePos, __ATOMIC_RELAXED);
+        } else {
+            // Another generator took this position
+            pos = __atomic_load_n(&buf->writePos, __ATOMIC_RELAXED);
         }
     }
 
-    if (semMutex != NULL) {
-        if (sem_post(semMutex) < 0) { // Resolve possible deadlocks
-            ERROR_MSG("Error while sem_post on free", strerror(errno));
+    for (size_t i = 0; i < count; i++) {
+        slot *s = &buf->data[(pos + i) % buf->capacity];
+        s->candidate = candidates[i];
+        __atomic_store_n(&s->sequence, pos + i + 1, __ATOMIC_RELEASE);
+    }
+    writeSignal();
+}
+
+/**
+ * @brief Count a candidate that was not submitted.
+ *
+ * This function adds the skipped candidates to `numberOfSkipped` in chunks of
+ * SKIP_REPORT and signals the supervisor, which counts them towards its limit.
+ *
+ * @param w The thread that skipped the candidate.
+ */
+static void skipCandidate(worker *w) {
+    if (++w->num_of_skipped == SKIP_REPORT) {
+        __atomic_add_fetch(&buf->numberOfSkipped, w->num_of_skipped, __ATOMIC_SEQ_CST);
+        w->num_of_skipped = 0;
+        writeSignal();
+    }
+}
+
+/**
+ * @brief Advance a splitmix64 generator.
+ *
+ * This function is only used to expand a seed into the state of the xoshiro256**
+ * generator, which must not be all zero.
+ *
+ * @param x The state of the splitmix64 generator.
+ * @return The next random number.
+ */
+static uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief Get the next number of a xoshiro256** generator.
+ *
+ * Every thread has its own generator. rand() shares a single state and
+ * glibc serializes all calls to it on a lock.
+ *
+ * @param s The state of the generator.
+ * @return The next random number.
+ */
+static inline uint64_t next_random(uint64_t s[4]) {
+    uint64_t result = s[1] * 5;
+    result = ((result << 7) | (result >> 57)) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 45) | (s[3] >> 19);
+
+    return result;
+}
+
+/**
+ * @brief Generate a random permutation of vertex indices.
+ *
+ * This function generates a random permutation of vertex indices using the Fisher-Yates
+ * shuffle algorithm. Shuffling any permutation gives a uniformly random one, so the
+ * array only has to be filled once.
+ *
+ * @param vertices An array containing a permutation of vertex indices.
+ * @param count The number of vertices in the array.
+ * @param rng The state of the random number generator of the thread.
+ */
+static void generate_random_permutation(uint32_t vertices[], size_t count, uint64_t rng[4]) {
+    for (size_t i = count - 1; i > 0; i--) {
+        // maps the upper 32 bits to [0, i] with a multiplication instead of a division
+        uint32_t j = ((next_random(rng) >> 32) * (i + 1)) >> 32;
+        uint32_t temp = vertices[j];
+        vertices[j] = vertices[i];
+        vertices[i] = temp;
+    }
+}
+
+/**
+ * @brief Count the backward edges of a component in a vertex ordering.
+ *
+ * This function walks the successors of one vertex after the other, so the
+ * successors are read sequentially and the position of the source only once.
+ *
+ * @param pos The position of every vertex in the ordering.
+ * @param c The component.
+ * @param limit The count at which the component is given up.
+ * @return The number of edges pointing to an earlier position, more than limit if it
+ * was given up.
+ */
+static size_t count_backward(const uint32_t pos[], size_t c, size_t limit) {
+    size_t count = 0;
+    for (size_t i = comp_start[c]; i < comp_start[c + 1] && count <= limit; i++) {
+        uint32_t u = comp_vertices[i];
+        uint32_t pos_u = pos[u];
+        for (size_t k = out_start[u]; k < out_start[u + 1]; k++) {
+            count += pos[out_list[k]] < pos_u;
         }
-        if (sem_close(semMutex) < 0) {
-            ERROR_MSG("Error closing mutex", strerror(errno));
+    }
+    return count;
+}
+
+/**
+ * @brief Start a candidate with the self loops of the graph.
+ *
+ * This function stores as many self loops in the candidate as it holds.
+ *
+ * @param candidate The edge_list to start.
+ * @return The number of self loops, which may be more than the candidate holds.
+ */
+static size_t start_candidate(edge_list *candidate) {
+    candidate->stored = 0;
+    candidate->optimal = false;
+    for (size_t i = 0; i < num_of_self_loops && i < MAX_CANDIDATE_EDGES; i++) {
+        candidate->list[i] = self_loops[i];
+        candidate->stored = i + 1;
+    }
+    return num_of_self_loops;
+}
+
+/**
+ * @brief Collect the backward edges of a vertex ordering as a candidate.
+ *
+ * This function walks the edges of all components like count_backward and appends
+ * the backward ones to the edges already in the candidate, but stops as soon as the
+ * candidate is no better than the limit.
+ *
+ * @param pos The position of every vertex in the ordering.
+ * @param candidate The edge_list the backward edges are appended to.
+ * @param limit The number of edges at which the candidate is given up.
+ * @return The number of edges in the candidate, limit if there are at least as many.
+ */
+static size_t collect_backward(const uint32_t pos[], edge_list *candidate, size_t limit) {
+    size_t delete_counter = candidate->stored;
+
+    for (size_t i = 0; i < comp_start[num_of_components]; i++) {
+        uint32_t u = comp_vertices[i];
+        uint32_t pos_u = pos[u];
+        for (size_t k = out_start[u]; k < out_start[u + 1]; k++) {
+            if (pos[out_list[k]] < pos_u) {
+                if (delete_counter == limit) {
+                    return limit;
+                }
+                candidate->list[delete_counter].u = u;
+                candidate->list[delete_counter].v = out_list[k];
+                candidate->stored = ++delete_counter;
+            }
         }
     }
+
+    return delete_counter;
 }
 
 /**
- * @brief Wait for semaphores before writing to the shared buffer.
+ * @brief Move a vertex to the position where the fewest of its edges point backwards.
+ *
+ * This function tries every insertion position of the vertex within its component,
+ * which includes the swaps with its neighbours in the ordering. Moving it past a single
+ * vertex u only changes the direction of the edges between the two, so the number of
+ * backward edges is updated incrementally with the edges to and from u marked beforehand.
  *
- * This function waits for the `semFree` semaphore to ensure there is space
- * in the shared buffer. If the program is flagged for termination, it exits
- * successfully. It also waits for the `semMutex` semaphore to prevent race
- * conditions with other writers.
+ * @param w The thread whose ordering is improved.
+ * @param v The vertex to be moved.
+ * @param first The first position of the component of v.
+ * @param last The position behind the last one of the component of v.
+ * @return The change of the number of backward edges, 0 if the vertex did not move.
  */
-static void writeWait() {
-    if (sem_wait(semFree) < 0) {
-        if (errno == EINTR) {
-            exit(EXIT_SUCCESS);
+static long sift_vertex(worker *w, uint32_t v, size_t first, size_t last) {
+    uint32_t *pos = w->permutation;
+    uint32_t *order = w->order;
+
+    for (size_t k = out_start[v]; k < out_start[v + 1]; k++) {
+        w->out_mark[out_list[k]]++;
+    }
+    for (size_t k = in_start[v]; k < in_start[v + 1]; k++) {
+        w->in_mark[in_list[k]]++;
+    }
+
+    size_t from = pos[v];
+    size_t to = from;
+    long delta = 0;
+    long best_delta = 0;
+
+    // moving v before u turns the edges u->v backwards and the edges v->u forwards
+    for (size_t p = from; p-- > first;) {
+        uint32_t u = order[p];
+        delta += (long)w->in_mark[u] - (long)w->out_mark[u];
+        if (delta < best_delta) {
+            best_delta = delta;
+            to = p;
         }
-        ERROR_EXIT("Error while waiting for free", strerror(errno));
     }
-    if (buf->terminate) {
-        exit(EXIT_SUCCESS);
+
+    delta = 0;
+    for (size_t p = from + 1; p < last; p++) {
+        uint32_t u = order[p];
+        delta += (long)w->out_mark[u] - (long)w->in_mark[u];
+        if (delta < best_delta) {
+            best_delta = delta;
+            to = p;
+        }
     }
-    if (sem_wait(semMutex)) {
-        if (errno == EINTR) {
-            exit(EXIT_SUCCESS);
+
+    for (size_t k = out_start[v]; k < out_start[v + 1]; k++) {
+        w->out_mark[out_list[k]] = 0;
+    }
+    for (size_t k = in_start[v]; k < in_start[v + 1]; k++) {
+        w->in_mark[in_list[k]] = 0;
+    }
+
+    if (to == from) {
+        return 0;
+    }
+
+    // shift the vertices in between by one position towards the old position of v
+    if (to < from) {
+        for (size_t p = from; p > to; p--) {
+            order[p] = order[p - 1];
+            pos[order[p]] = p;
+        }
+    } else {
+        for (size_t p = from; p < to; p++) {
+            order[p] = order[p + 1];
+            pos[order[p]] = p;
         }
-        ERROR_EXIT("Error while waiting for mutex", strerror(errno));
     }
+    order[to] = v;
+    pos[v] = to;
+
+    return best_delta;
 }
 
 /**
- * @brief Signal that writing to the shared buffer is complete.
+ * @brief Improve the ordering of a component by sifting until it is a local optimum.
  *
- * This function signals the completion of writing by posting to the `semMutex`
- * semaphore and the `semUsed` semaphore to indicate data availability.
+ * This function moves one vertex after the other to its best position and repeats
+ * this until no vertex can be moved to a better one. Every move strictly reduces the
+ * number of backward edges, so this always ends. The backward edges are only counted
+ * once, afterwards every move tells by how much it changed their number.
+ *
+ * @param w The thread whose ordering is improved.
+ * @param c The component.
+ * @param count The number of backward edges of the component before.
+ * @return The number of backward edges of the component after.
  */
-static void writeSignal() {
-    if (sem_post(semMutex) < 0) {
-        ERROR_EXIT("Error while posting mutex", strerror(errno));
-    }
-    if (sem_post(semUsed) < 0) {
-        ERROR_EXIT("Error while posting used", strerror(errno));
+static size_t improve_component(worker *w, size_t c, size_t count) {
+    bool improved = true;
+    while (improved && count > 0 && __atomic_load_n(&buf->terminate, __ATOMIC_RELAXED) == 0) {
+        improved = false;
+        for (size_t i = comp_start[c]; i < comp_start[c + 1] && count > 0; i++) {
+            long delta = sift_vertex(w, comp_vertices[i], comp_start[c], comp_start[c + 1]);
+            count += delta;
+            improved |= delta != 0;
+        }
     }
+
+    return count;
 }
 
 /**
- * @brief Write an edge_list to the shared buffer.
+ * @brief Try a new random ordering of a component and keep it if it is no worse.
  *
- * This function waits for semaphores, writes an `edge_list` to the shared buffer,
- * signals the completion of writing, and releases the semaphores.
+ * The components are independent, so every thread keeps the best ordering it found for
+ * each of them and its candidates combine these. A component that is ordered well stays
+ * so while the others are still searched.
  *
- * @param candidate The edge_list to be written to the shared buffer.
+ * @param w The thread whose ordering is changed.
+ * @param c The component.
  */
-static void bufferWrite(edge_list candidate) {
-    writeWait();
-    buf->data[buf->writePos] = candidate;
-    buf->writePos = (buf->writePos + 1) % BUF_SIZE;
-    writeSignal();
+static void sample_component(worker *w, size_t c) {
+    size_t first = comp_start[c];
+    size_t size = comp_start[c + 1] - first;
+    uint32_t *order = w->order + first;
+
+    memcpy(w->scratch, order, sizeof(uint32_t) * size);
+    generate_random_permutation(order, size, w->rng);
+    for (size_t i = 0; i < size; i++) {
+        w->permutation[order[i]] = first + i;
+    }
+
+    // the local search may still improve an ordering that starts out worse
+    size_t count = count_backward(w->permutation, c, local_search ? SIZE_MAX : w->comp_cost[c]);
+    if (local_search) {
+        count = improve_component(w, c, count);
+    }
+
+    if (count <= w->comp_cost[c]) {
+        w->comp_cost[c] = count;
+        return;
+    }
+
+    memcpy(order, w->scratch, sizeof(uint32_t) * size);
+    for (size_t i = 0; i < size; i++) {
+        w->permutation[order[i]] = first + i;
+    }
 }
 
 /**
- * @brief Fill an array with sequential vertex indices.
+ * @brief Generate and buffer solutions based on random permutations of edges.
  *
- * This function fills the provided array with sequential vertex indices from 0 to
- * `num_of_vertices - 1`.
+ * This function generates solutions by creating random permutations of the vertices of
+ * every component, applying them to the edges of the component, and buffering a solution
+ * if it removes fewer than 7 edges and fewer than the best solution of the supervisor.
+ * A component only takes the new permutation if it has no more backward edges than the
+ * one before, and the edges are only checked until it has. The self loops are part of
+ * every solution. As the components keep their best permutations, a solution is only
+ * buffered if it is also smaller than the last one of the thread.
+ * With the local search every permutation is improved before it is checked.
+ * Every thread runs this function until the program is flagged for termination.
  *
- * @param vertices An array to store sequential vertex indices.
+ * @param arg The worker of the thread.
+ * @return NULL
  */
-static void fill_vertex_array(long vertices[]) {
-    for (size_t i = 0; i < num_of_vertices; i++) {
-        vertices[i] = i;
+static void *generate_solutions(void *arg) {
+    worker *w = arg;
+
+    while (__atomic_load_n(&buf->terminate, __ATOMIC_RELAXED) == 0) {
+        size_t count = num_of_self_loops;
+        for (size_t c = 0; c < num_of_components; c++) {
+            sample_component(w, c);
+            count += w->comp_cost[c];
+        }
+
+        size_t best = __atomic_load_n(&buf->bestSize, __ATOMIC_RELAXED);
+        size_t limit = (best < 7) ? best : 7;
+        if (w->last_size < limit) {
+            limit = w->last_size;
+        }
+
+        // the candidate is built in place and only kept if it is good enough
+        edge_list *tmp = &w->pending[w->num_of_pending];
+        size_t delete_counter = count;
+        if (count < limit) {
+            start_candidate(tmp);
+            delete_counter = collect_backward(w->permutation, tmp, limit);
+        }
+
+        if (delete_counter < limit) {
+            w->last_size = delete_counter;
+            if (++w->num_of_pending == batch_size) {
+                bufferWrite(w->pending, w->num_of_pending);
+                w->num_of_pending = 0;
+            }
+            continue;
+        }
+
+        if (count < 7 && count >= best) {
+            // only count the candidates that the best solution cut off, like the supervisor would have
+            skipCandidate(w);
+        }
+        // improvements are rare, so they do not wait for a full batch
+        if (w->num_of_pending > 0) {
+            bufferWrite(w->pending, w->num_of_pending);
+            w->num_of_pending = 0;
+        }
     }
+
+    return NULL;
 }
 
 /**
- * @brief Generate a random permutation of vertex indices.
+ * The exact mode solves one component after the other, its vertices renumbered to
+ * 0 .. exact_n - 1. exact_mult[a][b] is the number of edges a->b, exact_succ[a] and
+ * exact_pred[a] are the sets of successors and predecessors of a.
+ */
+static size_t exact_n = 0;
+static uint32_t exact_mult[EXACT_MAX_VERTICES][EXACT_MAX_VERTICES];
+static uint64_t exact_succ[EXACT_MAX_VERTICES];
+static uint64_t exact_pred[EXACT_MAX_VERTICES];
+
+/**
+ * The state of the branch and bound: the best ordering found so far, its number of
+ * backward edges and the ordering of the current branch.
+ */
+static uint32_t bb_best;
+static uint8_t bb_best_order[EXACT_MAX_VERTICES];
+static uint8_t bb_order[EXACT_MAX_VERTICES];
+static uint64_t bb_nodes = 0;
+
+/**
+ * @brief Set up a component for the exact mode.
  *
- * This function generates a random permutation of vertex indices using the Fisher-Yates
- * shuffle algorithm.
+ * This function counts the edges between every pair of vertices of the component.
  *
- * @param vertices An array containing sequential vertex indices.
+ * @param c The component.
+ * @param local The index of every vertex within its component.
  */
-static void generate_random_permutation(long vertices[]) {
-    for (size_t i = num_of_vertices - 1; i > 0; i--) {
-        long j = rand() % (i + 1);
-        long temp = vertices[j];
-        vertices[j] = vertices[i];
-        vertices[i] = temp;
+static void exact_setup(size_t c, const uint32_t local[]) {
+    exact_n = comp_start[c + 1] - comp_start[c];
+    for (size_t a = 0; a < exact_n; a++) {
+        memset(exact_mult[a], 0, sizeof(exact_mult[a]));
+        exact_succ[a] = 0;
+        exact_pred[a] = 0;
+    }
+
+    for (size_t a = 0; a < exact_n; a++) {
+        uint32_t u = comp_vertices[comp_start[c] + a];
+        for (size_t k = out_start[u]; k < out_start[u + 1]; k++) {
+            uint32_t b = local[out_list[k]];
+            exact_mult[a][b]++;
+            exact_succ[a] |= (uint64_t)1 << b;
+            exact_pred[b] |= (uint64_t)1 << a;
+        }
     }
 }
 
+/**
+ * @brief Count the edges from a vertex into a set of vertices.
+ *
+ * @param v The vertex the edges start at.
+ * @param set The set of vertices the edges end in.
+ * @return The number of edges from v into set.
+ */
+static uint32_t exact_edges_to(size_t v, uint64_t set) {
+    uint32_t count = 0;
+    for (uint64_t bits = exact_succ[v] & set; bits != 0; bits &= bits - 1) {
+        count += exact_mult[v][__builtin_ctzll(bits)];
+    }
+    return count;
+}
 
 /**
- * @brief Generate and buffer solutions based on random permutations of edges.
+ * @brief Count the edges from a set of vertices into a vertex.
  *
- * This function generates solutions by creating random permutations of vertex indices,
- * applying a random permutation to the given edges, and buffering a solution if
- * certain conditions are met.
+ * @param v The vertex the edges end at.
+ * @param set The set of vertices the edges start at.
+ * @return The number of edges from set into v.
+ */
+static uint32_t exact_edges_from(size_t v, uint64_t set) {
+    uint32_t count = 0;
+    for (uint64_t bits = exact_pred[v] & set; bits != 0; bits &= bits - 1) {
+        count += exact_mult[__builtin_ctzll(bits)][v];
+    }
+    return count;
+}
+
+/**
+ * @brief Find an optimal ordering with dynamic programming over vertex subsets.
+ *
+ * The fewest backward edges of an ordering of a set S of vertices is the minimum over
+ * the last vertex v of S of the fewest backward edges of S without v plus the edges from
+ * v back into it. This takes 2^n * n steps and 2^n counters, so it is only used for up to
+ * EXACT_DP_VERTICES vertices. The ordering is recovered by walking back from the full
+ * set and picking a last vertex that achieves the minimum every time.
  *
- * @param edges An array of edges to generate solutions from.
+ * @param order An array to store the optimal ordering in.
+ * @return The number of backward edges of the ordering, UINT32_MAX if the program was
+ * flagged for termination meanwhile.
  */
-static void generate_solutions(edge edges[]) {
-    while (buf->terminate == 0) {
-        long random_permutation[num_of_vertices];
-        fill_vertex_array(random_permutation);
-        generate_random_permutation(random_permutation);
+static uint32_t exact_dp(uint8_t order[]) {
+    size_t full = ((size_t)1 << exact_n) - 1;
+    uint32_t *fewest = malloc(sizeof(uint32_t) * (full + 1));
+    if (fewest == NULL) {
+        ERROR_EXIT("Error allocating exact mode", strerror(errno));
+    }
 
-        edge_list tmp;
-        size_t delete_counter = 0;
-        tmp.stored = 0;
+    fewest[0] = 0;
+    for (size_t set = 1; set <= full; set++) {
+        if ((set & 0xFFFF) == 0 && __atomic_load_n(&buf->terminate, __ATOMIC_RELAXED)) {
+            free(fewest);
+            return UINT32_MAX;
+        }
 
-        for (size_t i = 0; i < num_of_edges && delete_counter < 7; i++) {
-            size_t pos_u = random_permutation[edges[i].u];
-            size_t pos_v = random_permutation[edges[i].v];
+        uint32_t min = UINT32_MAX;
+        for (size_t bits = set; bits != 0; bits &= bits - 1) {
+            size_t v = __builtin_ctzll(bits);
+            size_t prefix = set & ~((size_t)1 << v);
+            uint32_t cost = fewest[prefix] + exact_edges_to(v, prefix);
+            if (cost < min) {
+                min = cost;
+            }
+        }
+        fewest[set] = min;
+    }
 
-            if (pos_u > pos_v) {
-                tmp.list[delete_counter++] = edges[i];
-                tmp.stored = delete_counter;
+    size_t set = full;
+    for (size_t p = exact_n; p-- > 0;) {
+        for (size_t bits = set; bits != 0; bits &= bits - 1) {
+            size_t v = __builtin_ctzll(bits);
+            size_t prefix = set & ~((size_t)1 << v);
+            if (fewest[prefix] + exact_edges_to(v, prefix) == fewest[set]) {
+                order[p] = v;
+                set = prefix;
+                break;
             }
         }
+    }
 
-        if (delete_counter < 7) {
-            bufferWrite(tmp);
-            // another funny place
+    uint32_t optimum = fewest[full];
+    free(fewest);
+    return optimum;
+}
+
+/**
+ * @brief Search all orderings of the remaining vertices that can still beat the best one.
+ *
+ * The ordering is built from the front. Placing v next turns all edges from the other
+ * remaining vertices into v backwards. Of every pair of remaining vertices at least the
+ * smaller direction will point backwards, which gives the lower bound. A remaining vertex
+ * without edges from the others can always go first, so it is the only branch then.
+ *
+ * @param depth The number of vertices placed so far.
+ * @param remaining The set of vertices not placed yet.
+ * @param cost The number of backward edges among the placed vertices and into them.
+ * @param bound The lower bound of the backward edges among the remaining vertices.
+ * @return false if the program was flagged for termination, true otherwise.
+ */
+static bool exact_branch(size_t depth, uint64_t remaining, uint32_t cost, uint32_t bound) {
+    if (remaining == 0) {
+        if (cost < bb_best) {
+            bb_best = cost;
+            memcpy(bb_best_order, bb_order, exact_n);
+        }
+        return true;
+    }
+    if ((++bb_nodes & 0xFFFF) == 0 && __atomic_load_n(&buf->terminate, __ATOMIC_RELAXED)) {
+        return false;
+    }
+
+    // try the vertices with the fewest edges into them first
+    uint8_t vertex[EXACT_MAX_VERTICES];
+    uint32_t added[EXACT_MAX_VERTICES];
+    size_t count = 0;
+    for (uint64_t bits = remaining; bits != 0; bits &= bits - 1) {
+        uint8_t v = __builtin_ctzll(bits);
+        uint32_t in = exact_edges_from(v, remaining);
+        if (in == 0) {
+            vertex[0] = v;
+            added[0] = 0;
+            count = 1;
+            break;
+        }
+
+        size_t i = count++;
+        for (; i > 0 && added[i - 1] > in; i--) {
+            vertex[i] = vertex[i - 1];
+            added[i] = added[i - 1];
         }
+        vertex[i] = v;
+        added[i] = in;
     }
+
+    for (size_t i = 0; i < count; i++) {
+        uint8_t v = vertex[i];
+        uint64_t rest = remaining & ~((uint64_t)1 << v);
+
+        // the pairs with v leave the bound
+        uint32_t pairs = 0;
+        for (uint64_t bits = (exact_succ[v] & exact_pred[v]) & rest; bits != 0; bits &= bits - 1) {
+            size_t u = __builtin_ctzll(bits);
+            pairs += (exact_mult[v][u] < exact_mult[u][v]) ? exact_mult[v][u] : exact_mult[u][v];
+        }
+
+        if (cost + added[i] + bound - pairs >= bb_best) {
+            continue;
+        }
+        bb_order[depth] = v;
+        if (!exact_branch(depth + 1, rest, cost + added[i], bound - pairs)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Find an optimal ordering with branch and bound.
+ *
+ * The search starts from the best of EXACT_RESTARTS orderings of the local search, or
+ * from the best solution of the supervisor if that is better and the graph has a single
+ * component, and only looks for orderings with fewer backward edges.
+ *
+ * @param w The thread whose local search gives the first ordering.
+ * @param c The component.
+ * @param local The index of every vertex within its component.
+ * @param order An array to store the optimal ordering in.
+ * @return The number of backward edges of the ordering, UINT32_MAX if the program was
+ * flagged for termination meanwhile.
+ */
+static uint32_t exact_branch_and_bound(worker *w, size_t c, const uint32_t local[], uint8_t order[]) {
+    w->comp_cost[c] = SIZE_MAX;
+    for (size_t r = 0; r < EXACT_RESTARTS; r++) {
+        sample_component(w, c);
+    }
+    bb_best = w->comp_cost[c];
+    for (size_t a = 0; a < exact_n; a++) {
+        bb_best_order[a] = local[w->order[comp_start[c] + a]];
+    }
+
+    // with fewer backward edges than known the search has to find an ordering itself,
+    // the best solution of the supervisor counts the self loops as well
+    size_t best = __atomic_load_n(&buf->bestSize, __ATOMIC_RELAXED);
+    if (num_of_components == 1 && best >= num_of_self_loops && best - num_of_self_loops < bb_best) {
+        bb_best = best - num_of_self_loops + 1;
+    }
+
+    uint32_t bound = 0;
+    for (size_t a = 0; a < exact_n; a++) {
+        for (size_t b = a + 1; b < exact_n; b++) {
+            bound += (exact_mult[a][b] < exact_mult[b][a]) ? exact_mult[a][b] : exact_mult[b][a];
+        }
+    }
+
+    uint64_t all = (exact_n == 64) ? UINT64_MAX : ((uint64_t)1 << exact_n) - 1;
+    if (!exact_branch(0, all, 0, bound)) {
+        return UINT32_MAX;
+    }
+
+    memcpy(order, bb_best_order, exact_n);
+    return bb_best;
+}
+
+/**
+ * @brief Solve the feedback arc set problem exactly and submit the optimal solution.
+ *
+ * This function solves every component on its own, with the dynamic programming for up
+ * to EXACT_DP_VERTICES vertices and the branch and bound above. Together the optimal
+ * orderings of the components together with the self loops give the solution, which is
+ * written to the shared buffer flagged as optimal. If it has more edges than a candidate holds, only its size is sent.
+ *
+ * @param w The thread that solves the problem.
+ */
+static void solve_exactly(worker *w) {
+    uint32_t *local = malloc(sizeof(uint32_t) * num_of_vertices);
+    if (local == NULL) {
+        ERROR_EXIT("Error allocating exact mode", strerror(errno));
+    }
+    for (size_t c = 0; c < num_of_components; c++) {
+        for (size_t i = comp_start[c]; i < comp_start[c + 1]; i++) {
+            local[comp_vertices[i]] = i - comp_start[c];
+        }
+    }
+
+    size_t optimum = 0;
+    for (size_t c = 0; c < num_of_components; c++) {
+        exact_setup(c, local);
+
+        uint8_t order[EXACT_MAX_VERTICES];
+        uint32_t fewest = (exact_n <= EXACT_DP_VERTICES) ? exact_dp(order) : exact_branch_and_bound(w, c, local, order);
+        if (fewest == UINT32_MAX) {
+            free(local);
+            return;
+        }
+        optimum += fewest;
+
+        for (size_t p = 0; p < exact_n; p++) {
+            uint32_t v = comp_vertices[comp_start[c] + order[p]];
+            w->order[comp_start[c] + p] = v;
+            w->permutation[v] = comp_start[c] + p;
+        }
+    }
+    free(local);
+
+    // the self loops come on top of the optimum of the components
+    edge_list candidate;
+    optimum += start_candidate(&candidate);
+    if (optimum <= MAX_CANDIDATE_EDGES) {
+        collect_backward(w->permutation, &candidate, MAX_CANDIDATE_EDGES);
+    } else {
+        candidate.stored = optimum;
+    }
+    candidate.optimal = true;
+    bufferWrite(&candidate, 1);
 }
 
 /**
@@ -233,10 +896,10 @@ static void generate_solutions(edge edges[]) {
  * This function generates a random seed by combining the current time, clock, and
  * process ID. It can be used for seeding random number generation functions.
  *
- * @return An unsigned integer representing the random seed.
+ * @return A 64 bit integer representing the random seed.
  */
-static unsigned int get_random_seed() {
-    return time(NULL) * clock() * getpid();
+static uint64_t get_random_seed() {
+    return ((uint64_t)time(NULL) << 32) ^ ((uint64_t)getpid() << 16) ^ (uint64_t)clock();
 }
 
 
@@ -244,7 +907,7 @@ static unsigned int get_random_seed() {
  * @brief Perform startup operations for the generator process.
  *
  * This function sets up cleanup operations, opens shared memory, maps shared
- * memory, closes file descriptors, and opens semaphores for the generator process.
+ * memory and closes file descriptors for the generator process.
  */
 static void startup() {
     if (atexit(shutdown) < 0) {
@@ -259,34 +922,34 @@ static void startup() {
         ERROR_EXIT("Error opening shared memory", strerror(errno));
     }
 
+    // the supervisor sized the shared memory object for its buffer
+    struct stat info;
+    if (fstat(shmFd, &info) < 0) {
+        ERROR_EXIT("Error reading the size of shared memory", strerror(errno));
+    }
+    if (info.st_size < (off_t)BUF_BYTES(1)) {
+        ERROR_EXIT("Shared memory is not initialised yet", NULL);
+    }
+    bufBytes = info.st_size;
+
     // map shared memory object
-    buf = mmap(NULL, sizeof(*buf), PROT_READ | PROT_WRITE, MAP_SHARED, shmFd, 0);
+    buf = mmap(NULL, bufBytes, PROT_READ | PROT_WRITE, MAP_SHARED, shmFd, 0);
     if (buf == MAP_FAILED) {
+        buf = NULL;
         ERROR_EXIT("Error mapping shared memory", strerror(errno));
     }
+    if (buf->capacity < MIN_BUF_SIZE || BUF_BYTES(buf->capacity) > bufBytes) {
+        munmap(buf, bufBytes);
+        buf = NULL;
+        ERROR_EXIT("Shared memory holds no valid buffer", NULL);
+    }
 
     if (close(shmFd) < 0) {
         ERROR_EXIT("Error closing shared memory fd", strerror(errno));
     }
     shmFd = -1;
 
-    // open semaphores
-    semUsed = sem_open(SEM_USED, 0);
-    if (semUsed == SEM_FAILED) {
-        ERROR_EXIT("Error opening used", strerror(errno));
-    }
-
-    semFree = sem_open(SEM_FREE, 0);
-    if (semFree == SEM_FAILED) {
-        ERROR_EXIT("Error opening free", strerror(errno));
-    }
-
-    semMutex = sem_open(SEM_MUTEX, 0);
-    if (semMutex == SEM_FAILED) {
-        ERROR_EXIT("Error opening mutex", strerror(errno));
-    }
-
-    buf->numOfGenerators++;
+    __atomic_add_fetch(&buf->numOfGenerators, 1, __ATOMIC_SEQ_CST);
 }
 
 /**
@@ -333,6 +996,12 @@ static edge parseEdge(const char *input) {
         USAGE();
     }
 
+    if (u >= UINT32_MAX) {
+        fprintf(stderr, "[%s]: Vertex index %ld too large (at most %u)\n", PROGRAM_NAME, u, UINT32_MAX - 1);
+        free(tmp);
+        USAGE();
+    }
+
     // shift string pointer by one
     char *vertex2 = endptr + 1;
     long v = strtol(vertex2, &endptr, 0);
@@ -359,6 +1028,12 @@ static edge parseEdge(const char *input) {
         USAGE();
     }
 
+    if (v >= UINT32_MAX) {
+        fprintf(stderr, "[%s]: Vertex index %ld too large (at most %u)\n", PROGRAM_NAME, v, UINT32_MAX - 1);
+        free(tmp);
+        USAGE();
+    }
+
     free(tmp);
 
     // update number of vertices
@@ -374,6 +1049,198 @@ static edge parseEdge(const char *input) {
     return e;
 }
 
+/**
+ * @brief Build compressed sparse rows of the edges.
+ *
+ * This function counts the edges at every vertex and stores their other ends in a list,
+ * indexed by the returned starts.
+ *
+ * @param edges An array of the parsed edges.
+ * @param component The strongly connected component of every vertex, only the edges
+ * within a component are kept. NULL keeps all edges.
+ * @param successors true to store the successors of every vertex, false for the predecessors.
+ * @param list A pointer to store the list of the other ends in.
+ * @return The start of every vertex in the list, with the end of the list behind them.
+ */
+static size_t *build_rows(const edge edges[], const uint32_t component[], bool successors, uint32_t **list) {
+    size_t *start = calloc(num_of_vertices + 1, sizeof(size_t));
+    *list = malloc(sizeof(uint32_t) * (num_of_edges + 1));
+    if (start == NULL || *list == NULL) {
+        ERROR_EXIT("Error allocating adjacency", strerror(errno));
+    }
+
+    for (size_t i = 0; i < num_of_edges; i++) {
+        uint32_t from = successors ? edges[i].u : edges[i].v;
+        if (component == NULL || (edges[i].u != edges[i].v && component[edges[i].u] == component[edges[i].v])) {
+            start[from]++;
+        }
+    }
+    // afterwards the counter of every vertex is where its range ends
+    for (size_t v = 0; v < num_of_vertices; v++) {
+        start[v + 1] += start[v];
+    }
+    // fill from the back, so the counter of every vertex ends up at the start of its range
+    for (size_t i = num_of_edges; i-- > 0;) {
+        uint32_t from = successors ? edges[i].u : edges[i].v;
+        uint32_t to = successors ? edges[i].v : edges[i].u;
+        if (component == NULL || (edges[i].u != edges[i].v && component[edges[i].u] == component[edges[i].v])) {
+            (*list)[--start[from]] = to;
+        }
+    }
+
+    return start;
+}
+
+/**
+ * @brief Find the strongly connected components of the graph with Tarjan's algorithm.
+ *
+ * The depth first search keeps its own stack, so deep graphs can not overflow the stack
+ * of the thread. A vertex is on the stack of the algorithm as long as it is visited but
+ * has no component yet.
+ *
+ * @param count A pointer to store the number of components in.
+ * @return The component of every vertex.
+ */
+static uint32_t *find_components(size_t *count) {
+    uint32_t *component = malloc(sizeof(uint32_t) * num_of_vertices);
+    uint32_t *index = malloc(sizeof(uint32_t) * num_of_vertices);
+    uint32_t *low = malloc(sizeof(uint32_t) * num_of_vertices);
+    uint32_t *stack = malloc(sizeof(uint32_t) * num_of_vertices);
+    uint32_t *call = malloc(sizeof(uint32_t) * num_of_vertices);
+    size_t *next = malloc(sizeof(size_t) * num_of_vertices);
+    if (component == NULL || index == NULL || low == NULL || stack == NULL || call == NULL || next == NULL) {
+        ERROR_EXIT("Error allocating components", strerror(errno));
+    }
+
+    for (size_t v = 0; v < num_of_vertices; v++) {
+        index[v] = UINT32_MAX;
+        component[v] = UINT32_MAX;
+    }
+
+    uint32_t visited = 0;
+    size_t top = 0;
+    *count = 0;
+    for (size_t root = 0; root < num_of_vertices; root++) {
+        if (index[root] != UINT32_MAX) {
+            continue;
+        }
+
+        size_t depth = 0;
+        call[depth++] = root;
+        index[root] = low[root] = visited++;
+        stack[top++] = root;
+        next[root] = out_start[root];
+
+        while (depth > 0) {
+            uint32_t v = call[depth - 1];
+            if (next[v] < out_start[v + 1]) {
+                uint32_t u = out_list[next[v]++];
+                if (index[u] == UINT32_MAX) {
+                    index[u] = low[u] = visited++;
+                    stack[top++] = u;
+                    next[u] = out_start[u];
+                    call[depth++] = u;
+                } else if (component[u] == UINT32_MAX && index[u] < low[v]) {
+                    low[v] = index[u];
+                }
+                continue;
+            }
+
+            // all successors of v are done, v is the root of a component or passes low on
+            depth--;
+            if (low[v] == index[v]) {
+                uint32_t u;
+                do {
+                    u = stack[--top];
+                    component[u] = *count;
+                } while (u != v);
+                (*count)++;
+            }
+            if (depth > 0 && low[v] < low[call[depth - 1]]) {
+                low[call[depth - 1]] = low[v];
+            }
+        }
+    }
+
+    free(index);
+    free(low);
+    free(stack);
+    free(call);
+    free(next);
+    return component;
+}
+
+/**
+ * @brief Build the graph the generator searches.
+ *
+ * This function finds the strongly connected components, drops the edges between
+ * components and groups the vertices of the components with more than one vertex.
+ * The self loops are kept apart. For the local search the predecessors are stored as well.
+ *
+ * @param edges An array of the parsed edges.
+ */
+static void build_adjacency(const edge edges[]) {
+    self_loops = malloc(sizeof(edge) * (num_of_edges + 1));
+    if (self_loops == NULL) {
+        ERROR_EXIT("Error allocating self loops", strerror(errno));
+    }
+    for (size_t i = 0; i < num_of_edges; i++) {
+        if (edges[i].u == edges[i].v) {
+            self_loops[num_of_self_loops++] = edges[i];
+        }
+    }
+
+    out_start = build_rows(edges, NULL, true, &out_list);
+    size_t count;
+    uint32_t *component = find_components(&count);
+    free(out_start);
+    free(out_list);
+
+    out_start = build_rows(edges, component, true, &out_list);
+    if (local_search) {
+        in_start = build_rows(edges, component, false, &in_list);
+    }
+
+    // number the components with more than one vertex, in the order of Tarjan's algorithm
+    size_t *size = calloc(count + 1, sizeof(size_t));
+    comp_vertices = malloc(sizeof(uint32_t) * (num_of_vertices + 1));
+    if (size == NULL || comp_vertices == NULL) {
+        ERROR_EXIT("Error allocating components", strerror(errno));
+    }
+    for (size_t v = 0; v < num_of_vertices; v++) {
+        size[component[v]]++;
+    }
+    for (size_t c = 0; c < count; c++) {
+        size[c] = (size[c] > 1) ? num_of_components++ : SIZE_MAX;
+    }
+
+    comp_start = calloc(num_of_components + 1, sizeof(size_t));
+    if (comp_start == NULL) {
+        ERROR_EXIT("Error allocating components", strerror(errno));
+    }
+    for (size_t v = 0; v < num_of_vertices; v++) {
+        if (size[component[v]] != SIZE_MAX) {
+            comp_start[size[component[v]] + 1]++;
+        }
+    }
+    for (size_t c = 0; c < num_of_components; c++) {
+        comp_start[c + 1] += comp_start[c];
+    }
+    // the start of every component is moved on while its vertices are placed and moved back
+    for (size_t v = 0; v < num_of_vertices; v++) {
+        if (size[component[v]] != SIZE_MAX) {
+            comp_vertices[comp_start[size[component[v]]]++] = v;
+        }
+    }
+    for (size_t c = num_of_components; c > 0; c--) {
+        comp_start[c] = comp_start[c - 1];
+    }
+    comp_start[0] = 0;
+
+    free(size);
+    free(component);
+}
+
 /**
  * @brief Parse command line input to extract edge information.
  *
@@ -385,12 +1252,8 @@ static edge parseEdge(const char *input) {
  * @param edges An array to store parsed edge information.
  */
 static void parseInput(int argc, const char **argv, edge edges[]) {
-    if (argc < 2) {
-        USAGE();
-    }
-
-    for (size_t i = 1; i < argc; i++) {
-        edges[i - 1] = parseEdge(argv[i]);
+    for (size_t i = optind; i < argc; i++) {
+        edges[i - optind] = parseEdge(argv[i]);
     }
 }
 
@@ -403,17 +1266,149 @@ static void parseInput(int argc, const char **argv, edge edges[]) {
 int main(int argc, const char** argv) {
     PROGRAM_NAME = argv[0];
 
+    long bValue = DEFAULT_WRITE_BATCH; // Default value for b
+    long tValue = 1; // Default value for t
+
+    int opt;
+    char *endptr;
+
+    while ((opt = getopt(argc, (char *const *)argv, "b:t:le")) != -1) {
+        switch (opt) {
+            case 'b':
+                errno = 0; // Reset errno before calling strtol
+                bValue = strtol(optarg, &endptr, 10);
+
+                // Check for conversion errors
+                if (errno != 0 || *endptr != '\0' || bValue < 1 || bValue > MAX_WRITE_BATCH) {
+                    fprintf(stderr, "Invalid number for -b option\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 't':
+                errno = 0; // Reset errno before calling strtol
+                tValue = strtol(optarg, &endptr, 10);
+
+                // Check for conversion errors
+                if (errno != 0 || *endptr != '\0' || tValue < 1 || tValue > MAX_GENERATOR_THREADS) {
+                    fprintf(stderr, "Invalid number for -t option\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'l':
+                local_search = true;
+                break;
+            case 'e':
+                exact = true;
+                break;
+            default:
+                USAGE();
+        }
+    }
+
+    if (optind >= argc) {
+        USAGE();
+    }
+
     // initialise resources
     startup();
 
+    // a batch can never be larger than the whole buffer
+    batch_size = (bValue > buf->capacity) ? buf->capacity : bValue;
+
     // parse input
-    num_of_edges = argc-1;
+    num_of_edges = argc - optind;
     edge edges[num_of_edges];
     parseInput(argc, argv, edges);
+    if (exact) {
+        // the exact mode solves on the main thread and seeds the branch and bound with the local search
+        local_search = true;
+        tValue = 1;
+    }
+    build_adjacency(edges);
+
+    size_t largest = 0;
+    for (size_t c = 0; c < num_of_components; c++) {
+        if (comp_start[c + 1] - comp_start[c] > largest) {
+            largest = comp_start[c + 1] - comp_start[c];
+        }
+    }
+    if (exact && largest > EXACT_MAX_VERTICES) {
+        ERROR_EXIT("Too many vertices in a strongly connected component for the exact mode", NULL);
+    }
+
+    worker *workers = calloc(tValue, sizeof(worker));
+    if (workers == NULL) {
+        ERROR_EXIT("Error allocating generator threads", strerror(errno));
+    }
+
+    // every thread gets its own stream of random numbers
+    uint64_t seed = get_random_seed();
+    for (long i = 0; i < tValue; i++) {
+        workers[i].permutation = calloc(num_of_vertices, sizeof(uint32_t));
+        workers[i].order = malloc(sizeof(uint32_t) * (comp_start[num_of_components] + 1));
+        workers[i].scratch = malloc(sizeof(uint32_t) * (largest + 1));
+        workers[i].comp_cost = malloc(sizeof(size_t) * (num_of_components + 1));
+        if (workers[i].permutation == NULL || workers[i].order == NULL || workers[i].scratch == NULL ||
+            workers[i].comp_cost == NULL) {
+            ERROR_EXIT("Error allocating permutation", strerror(errno));
+        }
+
+        // the first ordering of every component is taken in any case
+        for (size_t p = 0; p < comp_start[num_of_components]; p++) {
+            workers[i].order[p] = comp_vertices[p];
+            workers[i].permutation[comp_vertices[p]] = p;
+        }
+        for (size_t c = 0; c < num_of_components; c++) {
+            workers[i].comp_cost[c] = SIZE_MAX;
+        }
+        workers[i].last_size = SIZE_MAX;
+
+        if (local_search) {
+            workers[i].out_mark = calloc(num_of_vertices, sizeof(uint32_t));
+            workers[i].in_mark = calloc(num_of_vertices, sizeof(uint32_t));
+            if (workers[i].out_mark == NULL || workers[i].in_mark == NULL) {
+                ERROR_EXIT("Error allocating local search", strerror(errno));
+            }
+        }
+        for (size_t k = 0; k < 4; k++) {
+            workers[i].rng[k] = splitmix64(&seed);
+        }
+    }
 
     // generate solution
-    srand(get_random_seed());
-    generate_solutions(edges);
+    long started = 0;
+    if (exact) {
+        solve_exactly(&workers[0]);
+    }
+    for (; started < tValue && !exact; started++) {
+        int err = pthread_create(&workers[started].thread, NULL, generate_solutions, &workers[started]);
+        if (err != 0) {
+            ERROR_MSG("Error creating generator thread", strerror(err));
+            break;
+        }
+    }
+
+    // the threads return once the supervisor terminates, only then the mapping may go
+    for (long i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    for (long i = 0; i < tValue; i++) {
+        free(workers[i].permutation);
+        free(workers[i].order);
+        free(workers[i].scratch);
+        free(workers[i].comp_cost);
+        free(workers[i].out_mark);
+        free(workers[i].in_mark);
+    }
+    free(workers);
+    free(out_start);
+    free(out_list);
+    free(in_start);
+    free(in_list);
+    free(comp_start);
+    free(comp_vertices);
+    free(self_loops);
 
-    exit(EXIT_SUCCESS);
+    exit((started > 0 || exact) ? EXIT_SUCCESS : EXIT_FAILURE);
 }
\ No newline at end of file
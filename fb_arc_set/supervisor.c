@@ -13,9 +13,7 @@
 
 static int shmFd = -1;
 static cbuf *buf = NULL;
-static sem_t *semUsed = NULL;
-static sem_t *semFree = NULL;
-static sem_t *semMutex = NULL;
+static size_t bufBytes = 0;
 
 static const char* PROGRAM_NAME;
 
@@ -54,7 +52,11 @@ static void ERROR_EXIT(char *message, char *error) {
  * exits the program with a failure status using the exit(EXIT_FAILURE) call.
  */
 static void USAGE() {
-    fprintf(stderr, "Usage: %s\n", PROGRAM_NAME);
+    fprintf(stderr, "Usage: %s [-n limit] [-w delay] [-s slots]\n", PROGRAM_NAME);
+    fprintf(stderr, "  -n limit  stop after limit candidates (default 0, no limit)\n");
+    fprintf(stderr, "  -w delay  wait delay seconds before reading candidates\n");
+    fprintf(stderr, "  -s slots  the number of candidates the shared buffer holds (default %d, %d to %d)\n",
+            DEFAULT_BUF_SIZE, MIN_BUF_SIZE, MAX_BUF_SIZE);
     exit(EXIT_FAILURE);
 }
 
@@ -75,20 +77,17 @@ static void handleSignal(int signal) {
  * @brief Perform cleanup and shutdown operations.
  *
  * This function performs cleanup operations, such as setting the termination
- * flag, releasing semaphores, closing file descriptors, and unlinking shared
+ * flag, waking waiting generators, closing file descriptors, and unlinking shared
  * memory, in preparation for program termination.
  */
 static void shutdown() {
     if (buf != NULL) {
-        buf->terminate = 1;
+        __atomic_store_n(&buf->terminate, 1, __ATOMIC_SEQ_CST);
 
         // Stop all waiting generators from waiting
-        if (semFree != NULL) {
-            for (size_t i = 0; i < buf->numOfGenerators; i++) {
-                if (sem_post(semFree) < 0) {
-                    ERROR_MSG("Error while sem_post for free", strerror(errno));
-                }
-            }
+        __atomic_add_fetch(&buf->freed, 1, __ATOMIC_SEQ_CST);
+        if (futexWake(&buf->freed, INT_MAX) < 0) {
+            ERROR_MSG("Error while waking the generators", strerror(errno));
         }
     }
 
@@ -99,40 +98,10 @@ static void shutdown() {
         shmFd = -1;
     }
 
-    if (semUsed != NULL) {
-        if (sem_close(semUsed) < 0) {
-            ERROR_MSG("Error closing used", strerror(errno));
-        }
-        if (sem_unlink(SEM_USED) < 0 && errno != ENOENT) {
-            // Only print the error if it's not "No such file or directory"
-            ERROR_MSG("Error unlinking USED", strerror(errno));
-        }
-    }
-
-    if (semFree != NULL) {
-        if (sem_close(semFree) < 0) {
-            ERROR_MSG("Error closing free", strerror(errno));
-        }
-        if (sem_unlink(SEM_FREE) < 0 && errno != ENOENT) {
-            // Only print the error if it's not "No such file or directory"
-            ERROR_MSG("Error unlinking FREE", strerror(errno));
-        }
-    }
-
-    if (semMutex != NULL) {
-        if (sem_close(semMutex) < 0) {
-            ERROR_MSG("Error closing mutex", strerror(errno));
-        }
-        if (sem_unlink(SEM_MUTEX) < 0 && errno != ENOENT) {
-            // Only print the error if it's not "No such file or directory"
-            ERROR_MSG("Error unlinking MUTEX", strerror(errno));
-        }
-    }
-
     // Unmap shared memory
     if (buf != NULL) {
         buf->terminate = 1;
-        if (munmap(buf, sizeof(*buf)) < 0) {
+        if (munmap(buf, bufBytes) < 0) {
             ERROR_MSG("Error unmapping shared memory", strerror(errno));
         }
     }
@@ -148,9 +117,11 @@ static void shutdown() {
  *
  * This function performs startup operations, such as setting a cleanup function
  * using atexit, creating shared memory, mapping shared memory, setting signal
- * handlers, initializing the buffer, and creating semaphores.
+ * handlers and initializing the buffer.
+ *
+ * @param slots The number of slots of the shared buffer.
  */
-static void startup() {
+static void startup(size_t slots) {
     // The atexit function in C is used to register a function to be called automatically when
     // the program terminates normally. It allows you to specify a function that should be executed
     // just before the program exits.
@@ -166,12 +137,13 @@ static void startup() {
 
     // In C programming, the ftruncate function is used to resize a file to a specified length.
     // This function is typically used with file descriptors and is part of the POSIX standard.
-    if (ftruncate(shmFd, sizeof(cbuf)) < 0) {
+    bufBytes = BUF_BYTES(slots);
+    if (ftruncate(shmFd, bufBytes) < 0) {
         ERROR_EXIT("Error setting size of shared memory", strerror(errno));
     }
 
     // map shared memory object
-    buf = mmap(NULL, sizeof(*buf), PROT_READ | PROT_WRITE, MAP_SHARED, shmFd, 0);
+    buf = mmap(NULL, bufBytes, PROT_READ | PROT_WRITE, MAP_SHARED, shmFd, 0);
     if (buf == MAP_FAILED) {
         ERROR_EXIT("Error mapping shared memory", strerror(errno));
     }
@@ -191,68 +163,127 @@ static void startup() {
     buf->terminate = 0;
     buf->readPos = 0;
     buf->writePos = 0;
+    buf->published = 0;
+    buf->freed = 0;
+    buf->readerWaiting = 0;
+    buf->writersWaiting = 0;
     buf->numOfGenerators = 0;
     buf->numberOfSolutions = 0;
+    buf->numberOfSkipped = 0;
+    buf->bestSize = SIZE_MAX;
+    buf->capacity = slots;
 
-
-    // create semaphores
-    semUsed = sem_open(SEM_USED, O_CREAT | O_EXCL, 0600, 0);
-    if (semUsed == SEM_FAILED) {
-        ERROR_EXIT("Error creating used", strerror(errno));
-    }
-    semFree = sem_open(SEM_FREE, O_CREAT | O_EXCL, 0600, BUF_SIZE);
-    if (semFree == SEM_FAILED) {
-        ERROR_EXIT("Error creating free", strerror(errno));
-    }
-    semMutex = sem_open(SEM_MUTEX, O_CREAT | O_EXCL, 0600, 1);
-    if (semMutex == SEM_FAILED) {
-        ERROR_EXIT("Error creating mutex", strerror(errno));
+    // slot i is free for position i
+    for (size_t i = 0; i < slots; i++) {
+        buf->data[i].sequence = i;
     }
 }
 
 /**
- * @brief Wait for a semaphore and check for termination.
+ * @brief Return the number of candidates the generators produced so far.
  *
- * This function waits for the `semUsed` semaphore, which signals that there is
- * data available in the shared buffer. If the semaphore wait fails, it checks
- * for the EINTR error (interrupted system call) and handles it by retrying the
- * wait. If the buffer is flagged for termination, the program exits.
+ * These are the candidates read by the supervisor and the ones the generators
+ * did not submit because they were no better than the best solution.
  */
-static void waitAndRead() {
-    if (sem_wait(semUsed) < 0) {
-        if (errno != EINTR) {
-            ERROR_EXIT("Error while executing sem_wait", strerror(errno));
+static long candidateCount() {
+    return buf->numberOfSolutions + __atomic_load_n(&buf->numberOfSkipped, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief Wait until a slot is published and check for termination.
+ *
+ * This function waits until the generator that reserved the position has
+ * published its slot. It spins for a short while, as candidates usually arrive
+ * quickly, and then sleeps on the `published` futex until a generator wakes it.
+ * An interrupted wait (EINTR) is retried. If the buffer is flagged for
+ * termination, the program exits.
+ *
+ * @param s The slot of the position.
+ * @param pos The position the supervisor reads next.
+ * @param maxSolutions The maximum number of candidates, 0 for no limit.
+ * @return true once the slot is published, false if the generators reached maxSolutions first.
+ */
+static bool waitAndRead(slot *s, uint64_t pos, long maxSolutions) {
+    for (unsigned int spins = 0; __atomic_load_n(&s->sequence, __ATOMIC_ACQUIRE) != pos + 1; spins++) {
+        if (__atomic_load_n(&buf->terminate, __ATOMIC_SEQ_CST)) {
+            exit(EXIT_SUCCESS);
+        }
+        if (maxSolutions != 0 && candidateCount() >= maxSolutions) {
+            return false;
+        }
+        if (spins < SPIN_LIMIT) {
+            continue;
         }
+
+        unsigned int published = __atomic_load_n(&buf->published, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&buf->readerWaiting, 1, __ATOMIC_SEQ_CST);
+
+        // A generator may have published the slot before it could see readerWaiting,
+        // otherwise futexWait returns right away as soon as published changed
+        if (__atomic_load_n(&s->sequence, __ATOMIC_SEQ_CST) != pos + 1) {
+            if (futexWait(&buf->published, published) < 0 && errno != EAGAIN && errno != EINTR) {
+                ERROR_EXIT("Error while waiting for a candidate", strerror(errno));
+            }
+        }
+        __atomic_store_n(&buf->readerWaiting, 0, __ATOMIC_SEQ_CST);
     }
-    if (buf->terminate) {
+    if (__atomic_load_n(&buf->terminate, __ATOMIC_SEQ_CST)) {
         exit(EXIT_SUCCESS);
     }
+    return true;
 }
 
 /**
  * @brief Signal that a read operation is complete.
  *
- * This function signals that a read operation is complete by posting to the
- * `semFree` semaphore, indicating that there is free space in the shared buffer.
+ * This function hands the slots to the next lap of the buffer and wakes the
+ * generators if any of them sleeps on the `freed` futex because the buffer was full.
+ *
+ * @param pos The position of the first slot that was read.
+ * @param count The number of slots that were read.
  */
-static void readSignal() {
-    if (sem_post(semFree) < 0) {
-        ERROR_EXIT("Error while sem_post", strerror(errno));
+static void readSignal(uint64_t pos, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        __atomic_store_n(&buf->data[(pos + i) % buf->capacity].sequence, pos + i + buf->capacity, __ATOMIC_RELEASE);
+    }
+    __atomic_add_fetch(&buf->freed, 1, __ATOMIC_SEQ_CST);
+    // Every freed slot lets at most one waiting generator continue
+    if (__atomic_load_n(&buf->writersWaiting, __ATOMIC_SEQ_CST) && futexWake(&buf->freed, (int)count) < 0) {
+        ERROR_EXIT("Error while waking the generators", strerror(errno));
     }
 }
 
 /**
- * @brief Read an edge_list from the shared buffer.
+ * @brief Read all published edge_lists from the shared buffer.
+ *
+ * This function waits until the next slot is published, copies it and all
+ * published slots after it (at most limit) out of the buffer, and frees them
+ * with a single signal. The supervisor is the only reader, so `readPos` needs
+ * no synchronisation.
  *
- * This function waits for a semaphore, reads an `edge_list` from the shared
- * buffer, signals the completion of the read, and returns the read `edge_list`.
+ * @param candidates An array for at least limit edge_lists.
+ * @param limit The maximum number of edge_lists to read, at least 1.
+ * @param maxSolutions The maximum number of candidates, see waitAndRead.
+ * @return The number of edge_lists read, 0 if the generators reached maxSolutions.
  */
-static edge_list readBuffer() {
-    waitAndRead();
-    edge_list candidate = buf->data[buf->readPos];
-    buf->readPos = (buf->readPos + 1) % BUF_SIZE;
-    readSignal();
-    return candidate;
+static size_t readBuffer(edge_list candidates[], size_t limit, long maxSolutions) {
+    uint64_t pos = buf->readPos;
+    size_t count = 0;
+
+    if (!waitAndRead(&buf->data[pos % buf->capacity], pos, maxSolutions)) {
+        return 0;
+    }
+    while (count < limit) {
+        slot *s = &buf->data[(pos + count) % buf->capacity];
+        if (__atomic_load_n(&s->sequence, __ATOMIC_ACQUIRE) != pos + count + 1) {
+            break;
+        }
+        candidates[count++] = s->candidate;
+    }
+
+    buf->readPos = pos + count;
+    readSignal(pos, count);
+    return count;
 }
 
 /**
@@ -260,29 +291,61 @@ static edge_list readBuffer() {
  *
  * This function continuously reads solutions from the shared buffer, increments
  * the count of solutions, and prints information about the best solutions found.
- * The function terminates when the buffer is flagged for termination or the
- * maximum number of solutions is reached.
+ * Every better solution is published in `bestSize` for the generators.
+ * The function terminates when the buffer is flagged for termination, the
+ * maximum number of solutions is reached, counting the ones the generators skipped,
+ * or a generator in exact mode sent an optimal solution.
  *
  * @param maxSolutions The maximum number of solutions to process. Use 0 for no limit.
  */
 static void solutions(long maxSolutions) {
     edge_list solution = { .stored = SIZE_MAX };
-    while (buf->terminate == 0 && (buf->numberOfSolutions < maxSolutions || maxSolutions == 0)) {
-        edge_list candidate = readBuffer();
-        buf->numberOfSolutions++;
-        if (candidate.stored == 0) {
-            printf("The graph is acyclic!\n");
-            buf->terminate = 1;
-        } else if (candidate.stored < solution.stored) {
-            solution = candidate;
-            fprintf(stderr,"Solution with %zu edges:", solution.stored);
-            for (size_t i = 0; i < solution.stored; i++) {
-                fprintf(stderr," %ld-%ld", solution.list[i].u, solution.list[i].v);
+    edge_list candidates[READ_BATCH];
+    bool proven = false;
+    while (buf->terminate == 0) {
+        // never take more candidates out of the buffer than -n allows, the generators
+        // keep adding skipped candidates, so the count is only read once
+        size_t limit = READ_BATCH;
+        if (maxSolutions != 0) {
+            long remaining = maxSolutions - candidateCount();
+            if (remaining <= 0) {
+                break;
+            }
+            if (remaining < READ_BATCH) {
+                limit = remaining;
+            }
+        }
+
+        size_t count = readBuffer(candidates, limit, maxSolutions);
+        for (size_t c = 0; c < count && buf->terminate == 0; c++) {
+            edge_list candidate = candidates[c];
+            buf->numberOfSolutions++;
+            if (candidate.stored == 0) {
+                printf("The graph is acyclic!\n");
+                buf->terminate = 1;
+                proven = true;
+            } else if (candidate.optimal && candidate.stored > MAX_CANDIDATE_EDGES) {
+                printf("The graph is not acyclic, an optimal solution removes %zu edges.\n", candidate.stored);
+                buf->terminate = 1;
+                proven = true;
+            } else if (candidate.stored < solution.stored || candidate.optimal) {
+                solution = candidate;
+                __atomic_store_n(&buf->bestSize, solution.stored, __ATOMIC_RELAXED);
+                fprintf(stderr,"Solution with %zu edges:", solution.stored);
+                for (size_t i = 0; i < solution.stored; i++) {
+                    fprintf(stderr," %ld-%ld", solution.list[i].u, solution.list[i].v);
+                }
+                fprintf(stderr, "\n");
+
+                if (candidate.optimal) {
+                    printf("The graph is not acyclic, an optimal solution removes %zu edges.\n", solution.stored);
+                    buf->terminate = 1;
+                    proven = true;
+                }
             }
-            fprintf(stderr, "\n");
         }
     }
-    if (maxSolutions <= buf->numberOfSolutions) {
+    if (!proven && maxSolutions <= candidateCount()) {
         printf("The graph might not be acyclic, best solution removes %zu edges.\n", solution.stored);
     }
 }
@@ -298,11 +361,12 @@ int main(int argc, char *argv[]) {
 
     long nValue = 0; // Default value for n
     long wValue = 0; // Default value for w
+    long sValue = DEFAULT_BUF_SIZE; // Default value for s
 
     int opt;
     char *endptr;
 
-    while ((opt = getopt(argc, argv, "hn:w:")) != -1) {
+    while ((opt = getopt(argc, argv, "hn:w:s:")) != -1) {
         switch (opt) {
             case 'h':
                 USAGE();
@@ -326,12 +390,22 @@ int main(int argc, char *argv[]) {
                     exit(EXIT_FAILURE);
                 }
                 break;
+            case 's':
+                errno = 0; // Reset errno before calling strtol
+                sValue = strtol(optarg, &endptr, 10);
+
+                // Check for conversion errors
+                if (errno != 0 || *endptr != '\0' || sValue < MIN_BUF_SIZE || sValue > MAX_BUF_SIZE) {
+                    fprintf(stderr, "Invalid number for -s option\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
             default:
                 USAGE();
         }
     }
 
-    startup();
+    startup(sValue);
     if (wValue < 0)  {
         ERROR_EXIT("value of -w should be greater than or equal to 0", strerror(errno));
     }
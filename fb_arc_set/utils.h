@@ -11,6 +11,7 @@
 
 #include <sys/mman.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 
 #include <stdint.h>
@@ -26,33 +27,145 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <time.h>
-#include <semaphore.h>
 #include <limits.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 #define SHM_NAME "/12219400_shm"
-#define BUF_SIZE (25)
-#define SEM_FREE "/12219400_free"
-#define SEM_USED "/12219400_used"
-#define SEM_MUTEX "/12219400_mutex"
+/**
+ * The number of slots of the shared buffer unless the supervisor is started with -s.
+ */
+#define DEFAULT_BUF_SIZE (4096)
+#define MAX_BUF_SIZE (1 << 24)
+
+/**
+ * With a single slot its published sequence pos + 1 would equal the one of the next lap.
+ */
+#define MIN_BUF_SIZE (2)
+
+/**
+ * A generator publishes its candidates in batches of this many slots unless it is started with -b.
+ * The supervisor takes up to READ_BATCH candidates out of the buffer at once.
+ */
+#define DEFAULT_WRITE_BATCH (16)
+#define MAX_WRITE_BATCH (256)
+#define READ_BATCH (256)
+
+/**
+ * A generator runs at most this many threads when it is started with -t.
+ */
+#define MAX_GENERATOR_THREADS (256)
+
+/**
+ * The exact mode of the generator solves every strongly connected component with dynamic
+ * programming over vertex subsets for up to EXACT_DP_VERTICES vertices and with branch and
+ * bound for up to EXACT_MAX_VERTICES.
+ * The branch and bound starts from the best of EXACT_RESTARTS orderings of the local search.
+ */
+#define EXACT_DP_VERTICES (25)
+#define EXACT_MAX_VERTICES (64)
+#define EXACT_RESTARTS (64)
+
+/**
+ * A generator adds the candidates it did not submit to numberOfSkipped in chunks of this many.
+ */
+#define SKIP_REPORT (1024)
+
+/**
+ * The number of times the supervisor checks an empty buffer again before it sleeps on a futex.
+ */
+#define SPIN_LIMIT (128)
 
 typedef struct {
     long u;
     long v;
 } edge;
 
+/**
+ * A candidate holds at most this many edges.
+ */
+#define MAX_CANDIDATE_EDGES (8)
+
+/**
+ * A candidate solution: the edges to remove. A generator in exact mode flags its solution as
+ * optimal; if it has more than MAX_CANDIDATE_EDGES edges, stored is its size and list is not used.
+ */
 typedef struct{
-    edge list[8];
+    edge list[MAX_CANDIDATE_EDGES];
     size_t stored;
+    bool optimal;
 } edge_list;
 
+/**
+ * A slot of the ring buffer. Its sequence tells whose turn it is: a generator may fill the slot for
+ * position pos once sequence == pos, and publishes it by setting sequence = pos + 1. The supervisor
+ * reads it once sequence == pos + 1 and hands it to the next lap with sequence = pos + capacity.
+ */
+typedef struct {
+    uint64_t sequence;
+    edge_list candidate;
+} slot;
+
+/**
+ * A lock-free ring buffer with many writers (the generators) and a single reader (the supervisor).
+ * A generator reserves a position by advancing writePos with a compare and swap, so generators only
+ * ever contend on that one word and never wait for each other. Positions only grow; the slot of a
+ * position is pos % capacity.
+ * The supervisor chooses the capacity at startup, the generators read it from the segment when they
+ * attach. The segment is the header followed by capacity slots, see BUF_BYTES.
+ * published and freed count the written and read slots. They are the futex words the supervisor
+ * sleeps on while the buffer is empty and the generators sleep on while it is full, and
+ * readerWaiting / writersWaiting tell the other side whether a wake up is needed at all.
+ * bestSize is the size of the best solution the supervisor has, so generators only submit candidates
+ * that beat it. The candidates they drop are counted in numberOfSkipped.
+ */
 typedef struct {
-    edge_list data[BUF_SIZE];
-    unsigned int readPos;
-    unsigned int writePos;
+    uint64_t writePos;
+    unsigned int published;
+    unsigned int writersWaiting;
+    // keep the words of the generators and the supervisor on separate cache lines
+    char padWriter[64 - sizeof(uint64_t) - 2 * sizeof(unsigned int)];
+    uint64_t readPos;
+    unsigned int freed;
+    unsigned int readerWaiting;
+    char padReader[64 - sizeof(uint64_t) - 2 * sizeof(unsigned int)];
+    uint64_t capacity;
     unsigned int terminate;
-    unsigned int numberOfGenerators;
     int numOfGenerators;
     long numberOfSolutions;
+    long numberOfSkipped;
+    size_t bestSize;
+    slot data[];
 } cbuf;
 
+/**
+ * The size of a shared buffer with the given number of slots.
+ */
+#define BUF_BYTES(capacity) (sizeof(cbuf) + (capacity) * sizeof(slot))
+
+/**
+ * @brief Sleep until the futex word no longer holds the expected value or a signal arrives.
+ *
+ * The word lives in shared memory, so the non-private futex operations are used.
+ *
+ * @param word The futex word.
+ * @param expected The value the word had when the caller decided to sleep.
+ * @return 0 after a wake up, -1 with errno EAGAIN if the word already changed or EINTR.
+ */
+static inline int futexWait(unsigned int *word, unsigned int expected) {
+    return (int)syscall(SYS_futex, word, FUTEX_WAIT, expected, NULL, NULL, 0);
+}
+
+/**
+ * @brief Wake processes sleeping on the futex word.
+ *
+ * @param word The futex word.
+ * @param count The maximum number of processes to wake, INT_MAX for all of them.
+ * @return The number of woken processes or -1 on error.
+ */
+static inline int futexWake(unsigned int *word, int count) {
+    return (int)syscall(SYS_futex, word, FUTEX_WAKE, count, NULL, NULL, 0);
+}
+
 #endif //FB_ARC_SET_UTILS_H